@@ -0,0 +1,45 @@
+// Counts heap allocations made through operator new, so a run can check that
+// the tick loop stops allocating once warmed up (main.cpp's --alloc-check).
+// It replaces the global operators, so include it from exactly one source
+// file per program. Python's own allocations go through malloc and are not
+// counted, and neither is anything allocated inside a brain.py call
+// (alloc_scope.h), which covers NumPy's C++ code: only the C++ side of the
+// tick is.
+#pragma once
+
+#include "alloc_scope.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<uint64_t> g_heapAllocs{0};
+
+static void* counted_alloc(std::size_t n,std::size_t align=0){
+  if(!g_allocUncounted) g_heapAllocs.fetch_add(1,std::memory_order_relaxed);
+  if(n==0) n=1;
+  if(align>alignof(std::max_align_t)) return std::aligned_alloc(align,(n+align-1)/align*align);
+  return std::malloc(n);
+}
+static void* counted_alloc_or_throw(std::size_t n,std::size_t align=0){
+  if(void* p=counted_alloc(n,align)) return p;
+  throw std::bad_alloc();
+}
+
+void* operator new(std::size_t n){ return counted_alloc_or_throw(n); }
+void* operator new[](std::size_t n){ return counted_alloc_or_throw(n); }
+void* operator new(std::size_t n,std::align_val_t a){ return counted_alloc_or_throw(n,(std::size_t)a); }
+void* operator new[](std::size_t n,std::align_val_t a){ return counted_alloc_or_throw(n,(std::size_t)a); }
+void* operator new(std::size_t n,const std::nothrow_t&) noexcept { return counted_alloc(n); }
+void* operator new[](std::size_t n,const std::nothrow_t&) noexcept { return counted_alloc(n); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p,std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p,std::size_t) noexcept { std::free(p); }
+void operator delete(void* p,std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p,std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p,std::size_t,std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p,std::size_t,std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p,const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p,const std::nothrow_t&) noexcept { std::free(p); }
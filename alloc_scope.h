@@ -0,0 +1,14 @@
+// Marks heap allocations that --alloc-check (alloc_count.h) should not count:
+// the ones made by the Python interpreter and its extension modules (NumPy's
+// C++ code goes through the same global operator new) while a thread is in a
+// brain.py call. Per thread, so an async brain thread doesn't hide the sim's.
+#pragma once
+
+inline thread_local int g_allocUncounted=0;
+
+struct UncountedAllocs {
+  UncountedAllocs(){ ++g_allocUncounted; }
+  ~UncountedAllocs(){ --g_allocUncounted; }
+  UncountedAllocs(const UncountedAllocs&)=delete;
+  UncountedAllocs& operator=(const UncountedAllocs&)=delete;
+};
@@ -0,0 +1,250 @@
+// Scaling benchmark for the simulation core. Steps one World per case
+// (agent count x coin density) with a fixed, cheap steering policy and
+// prints CSV: ns per tick and per agent, plus the per-phase split.
+//
+// Built from sim.h alone, no SDL or Python:
+//   g++ -std=c++17 -O2 bench.cpp -o bench -pthread
+// With -DBENCH_PYTHON (plus the Python flags) it also runs every case
+// through the embedded bridge and bench_brain.py, a stub policy with the
+// brain.py API, so the python rows minus the native rows are the bridge and
+// interpreter overhead per agent.
+//
+// ./bench --check-simd runs no benchmark: it checks that the SIMD integrate
+// kernel is bit-identical to the scalar one and exits 1 if it is not.
+#ifdef BENCH_PYTHON
+#include "pybrain.h"
+#endif
+#include "sim.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+#include <sstream>
+
+struct BenchConfig {
+  std::vector<int> agents={25,250,2500,25000};
+  std::vector<double> coinsPerAgent={0.0,1.0,4.0};
+  long ticks=300, warmup=30;
+  double budget=10.0;      // seconds of timed ticks per case; big cases stop early
+  uint32_t seed=1337;
+  bool python=false;
+  bool checkSimd=false;
+};
+
+template<class T> static std::vector<T> parse_list(const char* s){
+  std::vector<T> out; std::stringstream ss(s); std::string item;
+  while(std::getline(ss,item,',')) if(!item.empty()) out.push_back((T)std::atof(item.c_str()));
+  return out;
+}
+
+static void usage(const char* argv0){
+  std::fprintf(stderr,
+    "usage: %s [--agents 25,250,...] [--coins-per-agent 0,1,4] [--ticks N] [--warmup N] [--budget S]\n"
+    "          [--seed S] [--python] [--check-simd]\n"
+    "  prints CSV rows: mode,agents,coins,ticks,ns_per_tick,ns_per_agent,<phase>_ns...\n"
+    "  --budget S  stop timing a case after S seconds (the ticks column shows how many ran)\n"
+    "  --python  also time each case through the bridge with bench_brain.py (needs -DBENCH_PYTHON)\n"
+    "  --check-simd  compare the SIMD integrate kernel with the scalar one bit for bit, then exit\n", argv0);
+}
+
+static bool parse_args(int argc,char** argv,BenchConfig& cfg){
+  for(int i=1;i<argc;++i){
+    std::string a=argv[i];
+    const char* v=(i+1<argc)? argv[i+1] : nullptr;
+    if(a=="--agents" && v){ cfg.agents=parse_list<int>(v); ++i; }
+    else if(a=="--coins-per-agent" && v){ cfg.coinsPerAgent=parse_list<double>(v); ++i; }
+    else if(a=="--ticks"  && v){ cfg.ticks=std::max(1L,std::atol(v)); ++i; }
+    else if(a=="--warmup" && v){ cfg.warmup=std::max(0L,std::atol(v)); ++i; }
+    else if(a=="--budget" && v){ cfg.budget=std::atof(v); ++i; }
+    else if(a=="--seed"   && v){ cfg.seed=(uint32_t)std::strtoul(v,nullptr,10); ++i; }
+    else if(a=="--python") cfg.python=true;
+    else if(a=="--check-simd") cfg.checkSimd=true;
+    else return false;
+  }
+#ifndef BENCH_PYTHON
+  if(cfg.python){ std::fprintf(stderr,"--python needs a build with -DBENCH_PYTHON\n"); return false; }
+#endif
+  return true;
+}
+
+// Golden-angle headings that turn slowly; bench_brain.py uses the same formula
+// so both modes load the physics identically.
+static void steer(long tick,size_t n,float* vel,int32_t* intent){
+  for(size_t i=0;i<n;++i){
+    double a=(double)i*2.399963+(double)tick*0.01;
+    vel[2*i]=(float)(155.0*std::cos(a)); vel[2*i+1]=(float)(155.0*std::sin(a));
+    intent[i]=5;  // wander
+  }
+}
+
+// Steps two copies of the same agents, one through integrate_agents() (the
+// SIMD kernel plus the scalar tail) and one through the scalar kernel alone,
+// and memcmps every array after each step. Inputs are random values inside and
+// outside the clamp ranges, mixed with +-0, NaN, +-inf, denormals and
+// positions exactly on the world edges. Returns the number of mismatches.
+static long check_simd(uint32_t seed){
+#if defined(__AVX__) || defined(__SSE2__)
+  const size_t n=4099;   // not a multiple of the vector width, so the tail runs too
+  const float w=2048.0f, h=2048.0f;
+  const float inf=std::numeric_limits<float>::infinity(), nan=std::numeric_limits<float>::quiet_NaN();
+  const float denorm=std::numeric_limits<float>::denorm_min();
+  const float special[]={0.0f,-0.0f,nan,-nan,inf,-inf,denorm,-denorm,w,h,std::nextafter(w,inf),
+                         std::nextafter(0.0f,-1.0f),100.0f,std::nextafter(100.0f,inf),0.7f,1.0f};
+  const size_t nSpecial=sizeof(special)/sizeof(special[0]);
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> pos(-100.0f,w+100.0f), vel(-400.0f,400.0f), stat(-20.0f,120.0f), boost(-1.0f,5.0f);
+  std::uniform_int_distribution<int> pick(0,5);
+  std::uniform_int_distribution<size_t> which(0,nSpecial-1);
+  auto fill=[&](std::vector<float>& v,std::uniform_real_distribution<float>& d){
+    for(float& f:v) f= pick(rng)==0? special[which(rng)] : d(rng);
+  };
+  const float dts[]={1.0f/60.0f,1.0f/30.0f,0.25f,0.0f,-0.0f,1e-30f,1e30f};
+  const char* names[]={"x","y","vx","vy","health","energy","intel","speedBoostT"};
+  long bad=0, steps=0;
+  for(int round=0;round<50;++round){
+    Agents a;
+    a.reserve(n);
+    for(size_t i=0;i<n;++i) a.add("",0,0);
+    fill(a.x,pos); fill(a.y,pos); fill(a.vx,vel); fill(a.vy,vel);
+    fill(a.health,stat); fill(a.energy,stat); fill(a.intel,stat); fill(a.speedBoostT,boost);
+    Agents b=a;
+    for(float dt:dts)
+      for(int s=0;s<4;++s,++steps){
+        integrate_agents(a,dt,w,h);
+        integrate_agents_scalar(b,0,b.size(),dt,w,h);
+        std::vector<float>* fa[]={&a.x,&a.y,&a.vx,&a.vy,&a.health,&a.energy,&a.intel,&a.speedBoostT};
+        std::vector<float>* fb[]={&b.x,&b.y,&b.vx,&b.vy,&b.health,&b.energy,&b.intel,&b.speedBoostT};
+        for(int f=0;f<8;++f){
+          if(std::memcmp(fa[f]->data(),fb[f]->data(),n*sizeof(float))==0) continue;
+          for(size_t i=0;i<n;++i)
+            if(std::memcmp(&(*fa[f])[i],&(*fb[f])[i],sizeof(float)) && !bad++)
+              std::fprintf(stderr,"check-simd: first mismatch in %s[%zu] (round %d, dt %g): simd %a, scalar %a\n",
+                           names[f],i,round,dt,(*fa[f])[i],(*fb[f])[i]);
+          b=a;   // carry on from the same state
+        }
+      }
+  }
+  std::printf("check-simd: %ld steps of %zu agents (%s), %ld mismatching values\n",steps,n,
+#if defined(__AVX__)
+              "AVX",
+#else
+              "SSE2",
+#endif
+              bad);
+  return bad;
+#else
+  (void)seed;
+  std::printf("check-simd: this build has no SIMD integrate kernel\n");
+  return 0;
+#endif
+}
+
+struct Result { long ticks=0; double nsTick=0; double phase[PH_SIM_COUNT]={}; };
+
+#ifdef BENCH_PYTHON
+static PyBrain* g_brain=nullptr;
+#endif
+
+static Result run_case(const BenchConfig& cfg,int nAgents,int nCoins,bool python){
+  std::vector<World> worlds;
+  worlds.emplace_back(cfg.seed,nAgents,nCoins,"");
+  World& w=worlds[0];
+  std::mt19937 dropRng(cfg.seed^0x9e3779b9u);
+  std::uniform_real_distribution<float> dx(10.0f,WORLD_W-10.0f), dy(10.0f,WORLD_H-10.0f);
+
+  std::vector<float> vel(2*(size_t)nAgents);
+  std::vector<int32_t> intent((size_t)nAgents);
+#ifdef BENCH_PYTHON
+  RewardQueue batch;
+  if(python) g_brain->call_init(w.players.name,1);
+#else
+  (void)python;
+#endif
+
+  Result r;
+  uint64_t total=0, warmStart=prof_now_ns();
+  long warmup=cfg.warmup;
+  for(long t=0;t<warmup+cfg.ticks;++t){
+    // Warm up for the given ticks but at most a second; big cases need fewer.
+    if(t<warmup && prof_now_ns()-warmStart>1000000000ull) warmup=t;
+    const bool timed=t>=warmup;
+    uint64_t t0=prof_now_ns(), bridgeNs=0, brainNs=0, rewardNs=0;
+    w.begin_tick();
+    w.observe();   // the per-agent features every brain gets
+    const float* outVel=vel.data(); const int32_t* outIntent=intent.data();
+    bool decided=true;
+#ifdef BENCH_PYTHON
+    if(python){
+      uint64_t a=prof_now_ns();
+      g_brain->io.pack(worlds);
+      uint64_t b=prof_now_ns();
+      decided=g_brain->decide((int)w.tick,(float)w.dt);
+      brainNs=prof_now_ns()-b; bridgeNs=b-a;
+      outVel=g_brain->io.outVel.data(); outIntent=g_brain->io.outIntent.data();
+    } else
+#endif
+    steer(w.tick,(size_t)nAgents,vel.data(),intent.data());
+    w.advance(outVel,outIntent,decided);
+#ifdef BENCH_PYTHON
+    if(python){
+      uint64_t a=prof_now_ns();
+      batch.append(w.rewards,0);
+      g_brain->reward_batch(batch);
+      batch.clear();
+      rewardNs=prof_now_ns()-a;
+    }
+#endif
+    w.rewards.clear();
+    uint64_t t1=prof_now_ns();
+    if(timed){
+      total+=t1-t0; ++r.ticks;
+      r.phase[PH_BRIDGE]+=bridgeNs; r.phase[PH_BRAIN]+=brainNs; r.phase[PH_REWARDS]+=rewardNs;
+      for(int p=PH_FEATURES;p<=PH_RULES;++p) r.phase[p]+=w.phaseNs[p];
+    }
+    for(uint64_t& ns:w.phaseNs) ns=0;
+    // Keep the coin density steady (untimed): agents eat coins as they go.
+    while((int)w.coins.size()<nCoins) w.drop_coin(dx(dropRng),dy(dropRng));
+    if(timed && cfg.budget>0.0 && total*1e-9>=cfg.budget) break;
+  }
+  r.nsTick=(double)total/r.ticks;
+  for(double& p:r.phase) p/=r.ticks;
+  return r;
+}
+
+int main(int argc,char** argv){
+  BenchConfig cfg;
+  if(!parse_args(argc,argv,cfg)){ usage(argv[0]); return 2; }
+  if(cfg.checkSimd) return check_simd(cfg.seed)? 1 : 0;
+#ifdef BENCH_PYTHON
+  PyBrain brain;
+  if(cfg.python){
+    if(!brain.init("bench_brain")){ std::fprintf(stderr,"could not load bench_brain.py\n"); return 1; }
+    g_brain=&brain;
+  }
+#endif
+
+  std::printf("mode,agents,coins,ticks,ns_per_tick,ns_per_agent");
+  for(int p=0;p<PH_SIM_COUNT;++p) if(p!=PH_RECORD) std::printf(",%s_ns",PHASE_KEYS[p]);
+  std::printf("\n");
+  for(int n:cfg.agents){
+    if(n<1) continue;
+    for(double cpa:cfg.coinsPerAgent){
+      int coins=(int)std::lround(cpa*n);
+      for(int mode=0;mode<(cfg.python?2:1);++mode){
+        Result r=run_case(cfg,n,coins,mode==1);
+        std::printf("%s,%d,%d,%ld,%.0f,%.1f",mode?"python":"native",n,coins,r.ticks,r.nsTick,r.nsTick/n);
+        for(int p=0;p<PH_SIM_COUNT;++p) if(p!=PH_RECORD) std::printf(",%.0f",r.phase[p]);
+        std::printf("\n");
+        std::fflush(stdout);
+      }
+    }
+  }
+#ifdef BENCH_PYTHON
+  if(cfg.python) brain.shutdown();
+#endif
+  return 0;
+}
@@ -0,0 +1,28 @@
+# Stand-in for brain.py used by `bench --python`: same api, trivial policy,
+# so the timings are the bridge and interpreter cost per agent. The headings
+# match steer() in bench.cpp.
+import json, math
+
+_v = {}
+_n = 0
+
+def api_init(cfg):
+  global _n
+  c = json.loads(cfg) if cfg else {}
+  _n = len(c.get("players", []))
+  return json.dumps({"ok": True})
+
+def api_bind(views):
+  global _v
+  ints = ("coins","food","coin_off","out_intent","near_crate_type","friends","foes")
+  _v = {k: mv.cast("i" if k in ints else "f") for k, mv in views.items()}
+
+def api_tick(tick, dt, n_coins):
+  out = _v["out_vel"]; intent = _v["out_intent"]
+  for i in range(_n):
+    a = i*2.399963 + tick*0.01
+    out[2*i] = 155.0*math.cos(a); out[2*i+1] = 155.0*math.sin(a); intent[i] = 5
+
+def api_reward_batch(buf, n): pass
+def api_reward(player, value, reason): return json.dumps({"ok": True})
+def api_save(): return json.dumps({"ok": True})
@@ -1,12 +1,35 @@
-import json, math, random, pickle
+import json, math, random, struct, os, mmap, threading, queue, zlib
 from dataclasses import dataclass, field
 from pathlib import Path
 from typing import Dict, Tuple, List
+try: import numpy as np
+except ImportError: np=None   # the batched engine needs it; the scalar one does not
 
 SAVE_DIR = Path("./saves"); SAVE_DIR.mkdir(parents=True, exist_ok=True)
-STATE_PATH = SAVE_DIR / "brain_state.pkl"
+# Q-tables are checkpointed as a base file plus numbered deltas that hold only
+# the rows changed since the previous checkpoint (see Checkpointer).
+CKPT_EVERY = 180     # ticks between checkpoints
+COMPACT_AFTER = 32   # deltas the writer collects before folding them into the base
 FOOD_PRICE = 5
 ACTIONS = list(range(17))
+# Must match INTENT_NAMES in main.cpp; the bridge carries the index.
+INTENTS = ["idle","seek_coin","go_store","recharge","drift","wander"]
+INTENT_CODE = {n:i for i,n in enumerate(INTENTS)}
+# Must match RewardReason in main.cpp; api_reward_batch records carry the index.
+REASONS = ["buy_food_reserve","eat_food_delayed","recharge","maintain_food_reserve",
+           "collect_coin","crate_coins3","crate_food1","crate_speed","crate_heal30",
+           "too_close","death"]
+REWARD_REC = struct.Struct("=iid")  # agent index, reason code, value
+
+# Checkpoint file: header | names (u16 length + utf-8 each), padded to 8 |
+# rows of key (index into this file's names, px, py, friends, foes) + 17 Q
+# doubles. Rows are fixed size and 8-byte aligned, so the file can be mmapped
+# (or read with numpy) and a row decoded only when it is needed.
+CKPT_MAGIC = b"ECOBRN01"
+CKPT_HEAD = struct.Struct("<8sIIQQII")  # magic, version, kind (0 base, 1 delta), seq, tick, names, rows
+CKPT_KEY = struct.Struct("<5i4x")
+CKPT_Q = struct.Struct("<17d")
+CKPT_ROW = CKPT_KEY.size + CKPT_Q.size
 
 def clamp(v, lo, hi): return lo if v<lo else hi if v>hi else v
 def dist2(ax, ay, bx, by): dx=ax-bx; dy=ay-by; return dx*dx+dy*dy
@@ -15,6 +38,89 @@ def unit_towards(ax, ay, bx, by):
   dx, dy = bx-ax, by-ay; d = (dx*dx+dy*dy) ** 0.5
   return (0.0,0.0) if d==0 else (dx/d, dy/d)
 
+def ckpt_prefix(names):
+  # header space (packed last, once the row count is known) + names + padding
+  out=bytearray(CKPT_HEAD.size)
+  for n in names: b=n.encode(); out+=struct.pack("<H",len(b)); out+=b
+  out+=bytes(-len(out)%8)
+  return out
+
+def ckpt_encode(kind, seq, tick, names, rows):
+  # rows: (name index, state, q-values); packing copies them, so the tables may change afterwards
+  out=ckpt_prefix(names)
+  count=0
+  for ni,s,q in rows: out+=CKPT_KEY.pack(ni,*s); out+=CKPT_Q.pack(*q); count+=1
+  CKPT_HEAD.pack_into(out,0,CKPT_MAGIC,1,kind,seq,tick,len(names),count)
+  return out
+
+def ckpt_head(buf):
+  # -> (kind, seq, names, offset of the first row, rows)
+  magic,ver,kind,seq,_tick,nn,nr=CKPT_HEAD.unpack_from(buf,0)
+  if magic!=CKPT_MAGIC or ver!=1: raise ValueError("not a brain checkpoint")
+  off=CKPT_HEAD.size; names=[]
+  for _ in range(nn):
+    (l,)=struct.unpack_from("<H",buf,off); names.append(bytes(buf[off+2:off+2+l]).decode()); off+=2+l
+  off+=-off%8
+  if off+nr*CKPT_ROW>len(buf): raise ValueError("truncated checkpoint")
+  return kind,seq,names,off,nr
+
+def ckpt_parse(buf):
+  # -> (kind, seq, names, [(name, state, offset of its q doubles)])
+  kind,seq,names,off,nr=ckpt_head(buf)
+  rows=[]
+  for o in range(off,off+nr*CKPT_ROW,CKPT_ROW):
+    ni,px,py,fr,fo=CKPT_KEY.unpack_from(buf,o); rows.append((names[ni],(px,py,fr,fo),o+CKPT_KEY.size))
+  return kind,seq,names,rows
+
+def ckpt_arrays(buf):
+  # ckpt_parse for the batched engine: rows as one CKPT_DT array over buf
+  kind,seq,names,off,nr=ckpt_head(buf)
+  return kind,seq,names,(names,np.frombuffer(buf,CKPT_DT,count=nr,offset=off))
+
+def write_atomic(path, data):
+  tmp=path.with_name(path.name+".tmp")
+  with open(tmp,"wb") as f: f.write(data); f.flush(); os.fsync(f.fileno())
+  os.replace(tmp,path)
+
+class Checkpointer:
+  """Writes checkpoints off the tick path. The tick thread only packs the dirty
+  rows and queues them; this thread writes each batch as a delta and, every
+  COMPACT_AFTER deltas, merges base + deltas into a new base. Every file goes
+  to a temp name first and is renamed into place, so a crash at any point
+  leaves the last complete checkpoint readable."""
+  def __init__(self, d=SAVE_DIR):
+    self.dir=d; self.base=d / "brain_state.bin"
+    self.seq=0          # last sequence number handed out (tick thread)
+    self.deltas=[]      # delta files newer than the base (writer thread after start)
+    self.failed=0       # batches that could not be written (writer thread)
+    self.q=queue.Queue(); self.thread=None
+  def start(self):
+    self.thread=threading.Thread(target=self._run,name="brain-checkpoint",daemon=True); self.thread.start()
+  def delta_path(self, seq): return self.dir / f"brain_state.{seq:08d}.delta"
+  def submit(self, seq, blob): self.q.put((seq,blob))
+  def flush(self): self.q.join()
+  def _run(self):
+    while True:
+      seq,blob=self.q.get()
+      try:
+        p=self.delta_path(seq); write_atomic(p,blob); self.deltas.append(p)
+        if len(self.deltas)>=COMPACT_AFTER: self._compact(seq)
+      except Exception as e: self.failed+=1; print(f"brain: checkpoint {seq} failed: {e}")
+      finally: self.q.task_done()
+  def _compact(self, seq):
+    merged={}   # (name, state) -> packed q doubles; later files win
+    for p in ([self.base] if self.base.exists() else [])+self.deltas:
+      buf=p.read_bytes(); _,_,_,rows=ckpt_parse(buf)
+      for name,s,o in rows: merged[(name,s)]=buf[o:o+CKPT_Q.size]
+    index={}
+    for name,_ in merged: index.setdefault(name,len(index))
+    out=ckpt_prefix(index)
+    for (name,s),q in merged.items(): out+=CKPT_KEY.pack(index[name],*s); out+=q
+    CKPT_HEAD.pack_into(out,0,CKPT_MAGIC,1,0,seq,0,len(index),len(merged))
+    write_atomic(self.base,out)
+    for p in self.deltas: p.unlink(missing_ok=True)
+    self.deltas=[]
+
 @dataclass
 class Agent:
   name: str
@@ -25,10 +131,15 @@ class Agent:
   last_state: Tuple[int, ...] = None
   last_action: int = None
   rng: random.Random = field(default_factory=random.Random)
+  dirty: set = field(default_factory=set)     # states updated since the last checkpoint
+  disk: dict = field(default_factory=dict)    # state -> (buffer, offset) of a saved row not yet loaded
 
-  def _ensure(self,s): 
-    if s not in self.q: self.q[s]=[0.0]*len(ACTIONS)
-    return self.q[s]
+  def _ensure(self,s):
+    q=self.q.get(s)
+    if q is None:
+      src=self.disk.pop(s,None) if self.disk else None
+      q=self.q[s]=list(CKPT_Q.unpack_from(*src)) if src else [0.0]*len(ACTIONS)
+    return q
   def select_action(self,s):
     self._ensure(s)
     if self.rng.random()<self.epsilon: return self.rng.choice(ACTIONS)
@@ -36,94 +147,405 @@ class Agent:
   def update(self,s,a,r,sp):
     self._ensure(s); self._ensure(sp)
     self.q[s][a] += self.alpha * (r + self.gamma*max(self.q[sp]) - self.q[s][a])
+    self.dirty.add(s)
+
+# --brain numpy: every agent's Q-rows live in one float64 array (BatchEngine),
+# so a tick is a handful of array operations instead of a Python loop over
+# agents. A row is found by a packed int64 key (agent, px, py, friends, foes)
+# kept sorted next to its row number; new states are appended and merged in.
+# Same learner as Agent (epsilon, alpha, gamma, update order per agent), but
+# the random draws come from one NumPy stream keyed by tick, so its runs are
+# deterministic and shard-count independent but not the scalar engine's.
+BATCH_SEED = 0xEC05
+BATCH_FR_BITS = 10   # friends and foes per key; caps the agents per world at 1024
+if np is not None:
+  CKPT_DT = np.dtype([("k","<i4",(5,)),("pad","V4"),("q","<f8",(len(ACTIONS),))])
+  REWARD_DT = np.dtype([("i","<i4"),("r","<i4"),("v","<f8")])
+  DRIFT = np.array([(0,0),(0,-1),(0,1),(-1,0),(1,0),(-1,-1),(1,-1),(-1,1),(1,1)],dtype=np.float64)
+
+def batch_key(agent, px, py, fr, fo):
+  return (agent.astype(np.int64)<<42)|(px.astype(np.int64)<<31)|(py.astype(np.int64)<<20)|(fr.astype(np.int64)<<10)|fo.astype(np.int64)
+
+class BatchEngine:
+  epsilon=0.10; alpha=0.25; gamma=0.96
+
+  def __init__(self, n):
+    self.n=n                                    # agents, indexed 0..n-1 (the brain's [lo,hi))
+    cap=max(1024,64*n)
+    self.q=np.zeros((cap,len(ACTIONS)))
+    self.row_key=np.zeros(cap,np.int64)
+    self.dirty=np.zeros(cap,bool)               # rows updated since the last checkpoint
+    self.used=0
+    self.keys=np.zeros(0,np.int64)              # sorted
+    self.key_rows=np.zeros(0,np.int64)          # row of each key
+    self.last_row=np.full(n,-1,np.int64)        # -1: no decision yet
+    self.last_act=np.zeros(n,np.int64)
+
+  def rows(self, keys):
+    # Row of each key, adding zeroed rows for keys not seen before.
+    pos=np.searchsorted(self.keys,keys)
+    hit=pos<len(self.keys)
+    hit[hit]=self.keys[pos[hit]]==keys[hit]
+    if not hit.all():
+      self.add(np.unique(keys[~hit]))
+      pos=np.searchsorted(self.keys,keys)
+    return self.key_rows[pos]
+
+  def add(self, keys, q=None):
+    # keys: unique and not present yet
+    k=len(keys); ids=np.arange(self.used,self.used+k)
+    if self.used+k>len(self.q):
+      cap=max(2*len(self.q),self.used+k)
+      for name in ("q","row_key","dirty"):
+        old=getattr(self,name); new=np.zeros((cap,)+old.shape[1:],old.dtype); new[:self.used]=old[:self.used]
+        setattr(self,name,new)
+    self.q[ids]=0.0 if q is None else q
+    self.row_key[ids]=keys
+    self.used+=k
+    at=np.searchsorted(self.keys,keys)
+    self.keys=np.insert(self.keys,at,keys); self.key_rows=np.insert(self.key_rows,at,ids)
+
+  def select(self, rows, u, explore, tie):
+    # Epsilon-greedy for every agent at once; ties broken uniformly by `tie`.
+    qs=self.q[rows]
+    best=qs==qs.max(1)[:,None]
+    greedy=np.argmax(np.where(best,tie,-1.0),1)
+    return np.where(u<self.epsilon,explore,greedy), qs
+
+  def update(self, agents, r, target_max):
+    # One TD step on each agent's last (state, action): agents must be distinct.
+    lr=self.last_row[agents]; la=self.last_act[agents]
+    old=self.q[lr,la]
+    self.q[lr,la]=old+self.alpha*(r+self.gamma*target_max-old)
+    self.dirty[lr]=True
+
+  def reward(self, agents, values):
+    # Rewards in emission order. An agent's k-th reward of the batch goes in
+    # round k, so each round touches distinct agents and is one scatter.
+    ok=self.last_row[agents]>=0
+    agents=agents[ok]; values=values[ok]
+    if not len(agents): return
+    order=np.argsort(agents,kind="stable"); sa=agents[order]
+    starts=np.flatnonzero(np.r_[True,sa[1:]!=sa[:-1]])
+    rank=np.arange(len(sa))-np.repeat(starts,np.diff(np.r_[starts,len(sa)]))
+    for k in range(int(rank.max())+1):
+      sel=order[rank==k]; a=agents[sel]
+      self.update(a,values[sel],self.q[self.last_row[a]].max(1))
+
+  def decided(self, rows, act):
+    self.last_row[:]=rows; self.last_act[:]=act
+
+  def load(self, files, local):
+    # files: [(names, CKPT_DT rows)] oldest first; local maps a name to its agent.
+    ks=[]; qs=[]
+    for names,rec in files:
+      idx=np.array([local.get(n,-1) for n in names]+[-1],np.int64)
+      k=rec["k"]; a=idx[np.clip(k[:,0],-1,len(names)-1)]
+      lim=1<<BATCH_FR_BITS
+      ok=(a>=0)&(k[:,1]>=0)&(k[:,1]<2048)&(k[:,2]>=0)&(k[:,2]<2048)&(k[:,3]>=0)&(k[:,3]<lim)&(k[:,4]>=0)&(k[:,4]<lim)
+      ks.append(batch_key(a[ok],k[ok,1],k[ok,2],k[ok,3],k[ok,4])); qs.append(rec["q"][ok])
+    if not ks: return 0
+    ks=np.concatenate(ks)[::-1]; qs=np.concatenate(qs)[::-1]   # later files win
+    ks,first=np.unique(ks,return_index=True)
+    self.add(ks,qs[first])
+    return len(ks)
+
+  def checkpoint(self, names):
+    # -> (names, CKPT_DT rows) of the dirty rows, or None; names[i] is agent i's.
+    d=np.flatnonzero(self.dirty[:self.used])
+    if not len(d): return None
+    self.dirty[d]=False
+    key=self.row_key[d]
+    agents,ni=np.unique(key>>42,return_inverse=True)
+    rec=np.zeros(len(d),CKPT_DT)
+    rec["k"]=np.stack([ni,(key>>31)&0x7ff,(key>>20)&0x7ff,(key>>10)&0x3ff,key&0x3ff],1)
+    rec["q"]=self.q[d]
+    return [names[a] for a in agents], rec
 
 class Brain:
   def __init__(self):
     self.agents: Dict[str,Agent]={}
+    self.names: List[str]=[]
     self.tick=0; self.dt=0.016
     self.bounds={"w":2048,"h":2048}
     self.store={"x":0,"y":0,"w":360,"h":360}
     self.recharge={"x":2048-360,"y":0,"w":360,"h":360}
-    self.snapshot_every=360
+    self.worlds=1
+    self.v={}
+    self.ckpt=Checkpointer()
+    self.persist=True
+    self.batch=None   # BatchEngine with --brain numpy
+    self.a={}         # NumPy arrays over the views, for the batched engine
 
   def api_init(self, cfg_json):
     cfg=json.loads(cfg_json) if cfg_json else {}
     self.bounds=cfg.get("bounds",self.bounds)
     self.store=cfg.get("store",self.store)
     self.recharge=cfg.get("recharge",self.recharge)
-    for n in cfg.get("players",[]):
+    self.names=list(cfg.get("players",[]))
+    # Agents of world w are the w-th equal slice of names; worlds never interact.
+    self.worlds=max(1,int(cfg.get("worlds",1)))
+    # A --brain-shards worker decides for agents [lo,hi) only (it still sees
+    # every agent's state) and checkpoints them into its own directory.
+    shard=cfg.get("shard")
+    self.lo,self.hi=(int(shard["lo"]),int(shard["hi"])) if shard else (0,len(self.names))
+    for n in self.names[self.lo:self.hi]:
       if n not in self.agents:
-        a=Agent(name=n); a.rng.seed(sum(ord(c) for c in n)); self.agents[n]=a
-    self._save(); return {"ok":True,"players":list(self.agents.keys()),"food_price":FOOD_PRICE}
+        # Seeded from a hash of the whole name: a character sum gives w1/Player2
+        # and w2/Player1 the same exploration stream.
+        a=Agent(name=n); a.rng.seed(zlib.crc32(n.encode())); self.agents[n]=a
+    if cfg.get("engine")=="numpy" and self.batch is None:
+      if np is None: print("brain: numpy is not installed, using the scalar engine")
+      elif len(self.names)//self.worlds>1<<BATCH_FR_BITS: print("brain: too many agents per world for the numpy engine, using the scalar one")
+      else: self.batch=BatchEngine(self.hi-self.lo)
+    # persist=false (--brain parity): empty tables, and no checkpoint is read,
+    # written or deleted. Saves are only ever discarded for --fresh-brain.
+    self.persist=cfg.get("persist",True)
+    if self.persist and self.ckpt.thread is None:
+      if shard: self.ckpt=Checkpointer(SAVE_DIR/f"shards{shard['count']}"/str(shard['index']))
+      self.ckpt.dir.mkdir(parents=True, exist_ok=True)
+      if cfg.get("resume",True): self._load()
+      else: self._discard_saves()
+      self.ckpt.start()
+    return {"ok":True,"players":list(self.agents.keys()),"food_price":FOOD_PRICE}
+
+  def api_bind(self, views):
+    # Raw byte memoryviews over the C++ arrays, indexed like self.names.
+    ints=("coins","food","coin_off","out_intent","near_crate_type","friends","foes")
+    self.v={k:mv.cast("i" if k in ints else "f") for k,mv in views.items()}
+    if self.batch: self.a={k:np.asarray(mv) for k,mv in self.v.items()}
 
   def api_reward(self, player, value, reason):
+    if self.batch:
+      if player not in self.agents: return {"ok":False}
+      i=np.array([self.names.index(player)-self.lo]); ok=bool(self.batch.last_row[i[0]]>=0)
+      self.batch.reward(i,np.array([float(value)])); return {"ok":ok}
     a=self.agents.get(player)
     if not a or a.last_state is None or a.last_action is None: return {"ok":False}
     a.update(a.last_state,a.last_action,float(value),a.last_state); return {"ok":True}
 
-  def api_tick(self, world_json):
-    w=json.loads(world_json); self.tick=int(w.get("tick",self.tick+1)); self.dt=float(w.get("dt",self.dt))
-    self.bounds=w.get("bounds",self.bounds); self.store=w.get("store",self.store); self.recharge=w.get("recharge",self.recharge)
-    coins=w.get("coins",[]); players=w.get("players",{})
+  def api_reward_batch(self, buf, n):
+    # One tick of (agent, reason, value) records, applied in emission order.
+    if self.batch:
+      rec=np.frombuffer(buf,REWARD_DT,count=n)
+      i=rec["i"].astype(np.int64)-self.lo; mine=(i>=0)&(i<self.hi-self.lo)
+      self.batch.reward(i[mine],rec["v"][mine]); return
+    names=self.names; agents=self.agents
+    for i,_reason,value in REWARD_REC.iter_unpack(buf[:REWARD_REC.size*n]):
+      a=agents.get(names[i])
+      if a is None or a.last_state is None or a.last_action is None: continue
+      a.update(a.last_state,a.last_action,value,a.last_state)
 
-    dec={}
-    for name,p in players.items():
-      a=self.agents.setdefault(name,Agent(name=name))
-      obs=self._obs(name,p,players,coins); s=self._disc(obs); act=a.select_action(s)
-      ux,uy,beh=self._policy(act,name,p,obs,coins)
+  def api_tick(self, tick, dt, n_coins):
+    self.tick=int(tick); self.dt=float(dt)
+    if self.batch: return self._tick_batched()
+    v=self.v; all_coins=v["coin_xy"][:2*n_coins]; off=v["coin_off"]
+    out_vel=v["out_vel"]; out_intent=v["out_intent"]
+    per=len(self.names)//self.worlds
+    world_coins=[all_coins[2*off[w]:2*off[w+1]] for w in range(self.worlds)]
+    for i in range(self.lo,self.hi):
+      a=self.agents[self.names[i]]
+      w=i//per; coins=world_coins[w]
+      obs=self._obs(i,coins,w*per,(w+1)*per); s=self._disc(obs); act=a.select_action(s)
+      ux,uy,beh=self._policy(act,i,obs,coins)
 
       prox = obs["crowd"]["foes"] + obs["crowd"]["friends"]
       r = -0.01 * prox
-      if obs["in_store"] and (p.get("coins",0)>=FOOD_PRICE or p.get("food",0)>0): r += 0.05
-      if obs["in_recharge"] and p.get("energy",100.0)<90: r += 0.05
+      if obs["in_store"] and (v["coins"][i]>=FOOD_PRICE or v["food"][i]>0): r += 0.05
+      if obs["in_recharge"] and v["energy"][i]<90: r += 0.05
       if a.last_state is not None and a.last_action is not None: a.update(a.last_state,a.last_action,r,s)
       a.last_state=s; a.last_action=act
-      dec[name]={"vx":ux,"vy":uy,"intent":beh,"hud":self._hud(name,p,beh)}
-    if (self.tick%180)==0: self._save()
-    return {"ok":True,"decisions":dec}
+      out_vel[2*i]=ux; out_vel[2*i+1]=uy; out_intent[i]=INTENT_CODE[beh]
+    if (self.tick%CKPT_EVERY)==0: self._checkpoint()
+
+  def _tick_batched(self):
+    # api_tick for every agent in [lo,hi) at once: the same observation,
+    # policy and shaping reward as _obs/_policy, as array operations.
+    A=self.a; lo,hi=self.lo,self.hi; E_=self.batch
+    per=len(self.names)//self.worlds
+    x=A["x"][lo:hi].astype(np.float64); y=A["y"][lo:hi].astype(np.float64)
+    H=A["health"][lo:hi]; E=A["energy"][lo:hi]; C=A["coins"][lo:hi]; F=A["food"][lo:hi]
+    fr=A["friends"][lo:hi]; fo=A["foes"][lo:hi]
+    off=A["coin_off"]; w=np.arange(lo,hi)//per
+    has_coins=off[w+1]>off[w]
+
+    px=np.floor_divide(x,128).astype(np.int64); py=np.floor_divide(y,128).astype(np.int64)
+    rows=E_.rows(batch_key(np.arange(hi-lo),px,py,fr,fo))
+    # One stream per tick, drawn for every agent so a shard takes its own slice.
+    g=np.random.default_rng([BATCH_SEED,self.tick]); N=len(self.names)
+    u=g.random(N)[lo:hi]; explore=g.integers(0,len(ACTIONS),N)[lo:hi]
+    tie=g.random((N,len(ACTIONS)))[lo:hi]; ang=g.random(N)[lo:hi]*6.2831853
+    act,qs=E_.select(rows,u,explore,tie)
+
+    st,rc=self.store,self.recharge
+    in_store=(st["x"]<=x)&(x<=st["x"]+st["w"])&(st["y"]<=y)&(y<=st["y"]+st["h"])
+    in_rech=(rc["x"]<=x)&(x<=rc["x"]+rc["w"])&(rc["y"]<=y)&(y<=rc["y"]+rc["h"])
+    need_store=((C>=FOOD_PRICE)&((H<85)|(E<70)))|((F>0)&((H<80)|(E<80)))
+    a=np.where(E<15,11,np.where(need_store,10,np.where(has_coins&(C<FOOD_PRICE),9,act)))
+
+    speed=155.0
+    tx=np.zeros_like(x); ty=np.zeros_like(y)
+    coin=(a==9)&has_coins&(A["near_coin_dist"][lo:hi]>=0)
+    nc=A["near_coin"][2*lo:2*hi].reshape(-1,2)
+    tx[coin]=nc[coin,0]; ty[coin]=nc[coin,1]
+    tx[a==10]=st["x"]+st["w"]/2; ty[a==10]=st["y"]+st["h"]/2
+    tx[a==11]=rc["x"]+rc["w"]/2; ty[a==11]=rc["y"]+rc["h"]/2
+    seek=coin|(a==10)|(a==11)
+    dx=tx-x; dy=ty-y; d=np.sqrt(dx*dx+dy*dy); d[~seek|(d==0)]=np.inf
+    ux=np.where(seek,dx/d*speed,0.0); uy=np.where(seek,dy/d*speed,0.0)
+    drift=(a>=1)&(a<=8)
+    ux[drift]=DRIFT[a[drift],0]*speed; uy[drift]=DRIFT[a[drift],1]*speed
+    wander=a==14
+    ux[wander]=np.cos(ang[wander])*speed; uy[wander]=np.sin(ang[wander])*speed
+    intent=np.zeros(hi-lo,np.int32)
+    intent[coin]=INTENT_CODE["seek_coin"]; intent[a==10]=INTENT_CODE["go_store"]; intent[a==11]=INTENT_CODE["recharge"]
+    intent[drift]=INTENT_CODE["drift"]; intent[wander]=INTENT_CODE["wander"]
+
+    r=-0.01*(fo+fr)
+    r=np.where(in_store&((C>=FOOD_PRICE)|(F>0)),r+0.05,r)
+    r=np.where(in_rech&(E<90),r+0.05,r)
+    had=np.flatnonzero(E_.last_row>=0)
+    E_.update(had,r[had],qs[had].max(1))
+    E_.decided(rows,act)
+    vel=A["out_vel"][2*lo:2*hi].reshape(-1,2)
+    vel[:,0]=ux; vel[:,1]=uy
+    A["out_intent"][lo:hi]=intent
+    if (self.tick%CKPT_EVERY)==0: self._checkpoint()
+
+  def api_hud(self, i):
+    # Hover text for agent i as of the last api_tick; the engine asks only for
+    # the agents it is showing, so nothing is formatted per tick.
+    v=self.v
+    if not v or not 0<=i<len(self.names): return ""
+    return (f"{self.names[i]} | H:{int(v['health'][i])} E:{int(v['energy'][i])} "
+            f"C:{int(v['coins'][i])} F:{int(v['food'][i])} "
+            f"P:{int(v['perf'][i])} Act:{INTENTS[v['out_intent'][i]]}")
 
-  def api_save(self): self._save(); return {"ok":True}
-  def _save(self):
-    blob={"tick":self.tick,"bounds":self.bounds,"store":self.store,"recharge":self.recharge,
-          "agents":{k:{"epsilon":ag.epsilon,"alpha":ag.alpha,"gamma":ag.gamma,"q":ag.q} for k,ag in self.agents.items()}}
-    with open(STATE_PATH,"wb") as f: pickle.dump(blob,f)
+  def api_save(self):
+    if self.persist:
+      self._checkpoint(); self.ckpt.flush()
+      # Deltas only hold what changed, so one lost batch means a stale save.
+      if self.ckpt.failed: raise OSError(f"{self.ckpt.failed} checkpoint(s) could not be written to {self.ckpt.dir}")
+    return {"ok":True}
+
+  def _checkpoint(self):
+    # Tick-thread part: copy out the dirty rows; the file work is the writer's.
+    if not self.persist: return
+    if self.batch:
+      dirty=self.batch.checkpoint(self.names[self.lo:self.hi])
+      if dirty is None: return
+      names,rec=dirty
+      self.ckpt.seq+=1
+      out=ckpt_prefix(names)
+      CKPT_HEAD.pack_into(out,0,CKPT_MAGIC,1,1,self.ckpt.seq,self.tick,len(names),len(rec))
+      self.ckpt.submit(self.ckpt.seq,out+rec.tobytes())
+      return
+    names=[]; rows=[]
+    for name,a in self.agents.items():
+      if not a.dirty: continue
+      ni=len(names); names.append(name)
+      rows.extend((ni,s,a.q[s]) for s in a.dirty)
+      a.dirty=set()
+    if not rows: return
+    self.ckpt.seq+=1
+    self.ckpt.submit(self.ckpt.seq,ckpt_encode(1,self.ckpt.seq,self.tick,names,rows))
+
+  def _load(self):
+    # Lazy: only keys are read here; each row is unpacked the first time its
+    # agent reaches that state. The base stays mmapped; deltas are small.
+    # The batched engine reads every row up front, straight into its array.
+    parse=ckpt_arrays if self.batch else ckpt_parse
+    loaded=self._read_saves(self.ckpt,own=True,parse=parse)
+    if not loaded and self.ckpt.dir!=SAVE_DIR:
+      # First run with this shard count: start from the single-process checkpoint, read only.
+      loaded=self._read_saves(Checkpointer(),own=False,parse=parse)
+    if self.batch:
+      local={n:i for i,n in enumerate(self.names[self.lo:self.hi])}
+      n=self.batch.load([rows for _,rows in loaded],local)
+      if n: print(f"brain: resuming from {n} saved Q-rows (checkpoint {self.ckpt.seq})")
+      return
+    for buf,rows in loaded:
+      for name,s,o in rows:
+        a=self.agents.get(name)
+        if a: a.disk[s]=(buf,o)
+    n=sum(len(a.disk) for a in self.agents.values())
+    if n: print(f"brain: resuming from {n} saved Q-rows (checkpoint {self.ckpt.seq})")
+
+  def _read_saves(self, ck, own, parse=ckpt_parse):
+    # -> [(buffer, rows)] of ck's base and newer deltas; `own` also adopts the
+    # deltas for compaction and drops the ones the base already holds.
+    files=[]
+    try:
+      if ck.base.exists() and ck.base.stat().st_size>0:
+        with open(ck.base,"rb") as f: files.append(mmap.mmap(f.fileno(),0,access=mmap.ACCESS_READ))
+    except OSError as e: print(f"brain: cannot map {ck.base}: {e}")
+    base_seq=0
+    loaded=[]
+    for buf in files:
+      try: _,base_seq,_,rows=parse(buf); loaded.append((buf,rows))
+      except ValueError as e: print(f"brain: ignoring {ck.base}: {e}")
+    for p in sorted(ck.dir.glob("brain_state.*.delta")):
+      seq=int(p.name.split(".")[1])
+      if seq<=base_seq:   # already folded into the base
+        if own: p.unlink(missing_ok=True)
+        continue
+      try:
+        buf=p.read_bytes(); _,_,_,rows=parse(buf); loaded.append((buf,rows))
+        if own: ck.deltas.append(p); ck.seq=max(ck.seq,seq)
+      except ValueError as e: print(f"brain: ignoring {p}: {e}")
+    if own: ck.seq=max(ck.seq,base_seq)
+    return loaded
+
+  def _discard_saves(self):
+    d=self.ckpt.dir
+    for p in [self.ckpt.base]+list(d.glob("brain_state.*.delta")): p.unlink(missing_ok=True)
 
   def _nearest_coin(self,px,py,coins):
+    # coins is a flat x0,y0,x1,y1,... view
     if not coins: return None, None
     best=None; bd=1e30
-    for c in coins:
-      d=dist2(px,py,c["x"],c["y"])
-      if d<bd: bd=d; best=c
-    return best, bd
-
-  def _obs(self,me,mep,players,coins):
-    px,py=mep.get("x",0.0),mep.get("y",0.0)
-    fr=fo=0
-    for n,p in players.items():
-      if n==me: continue
-      d2=dist2(px,py,p.get("x",0.0),p.get("y",0.0))
-      if d2<=200*200:
-        sm=mep.get("coins",0)+mep.get("food",0)
-        so=p.get("coins",0)+p.get("food",0)
-        if so>sm: fo+=1
-        else: fr+=1
-    coin,_=self._nearest_coin(px,py,coins)
+    for k in range(0,len(coins),2):
+      d=dist2(px,py,coins[k],coins[k+1])
+      if d<bd: bd=d; best=k
+    return (coins[best],coins[best+1]), bd
+
+  def _obs(self,me,coins,lo,hi):
+    # coins and the crowd scan [lo,hi) cover only me's own world
+    v=self.v; xs,ys=v["x"],v["y"]; cs,fs=v["coins"],v["food"]
+    px,py=xs[me],ys[me]
+    crate=None
+    if "friends" in v:
+      # The engine already found these through its spatial grid (same results as the scans below).
+      fr=v["friends"][me]; fo=v["foes"][me]
+      coin=(v["near_coin"][2*me],v["near_coin"][2*me+1]) if v["near_coin_dist"][me]>=0 else None
+      if v["near_crate_dist"][me]>=0: crate=(v["near_crate"][2*me],v["near_crate"][2*me+1],v["near_crate_type"][me])
+    else:
+      fr=fo=0
+      sm=cs[me]+fs[me]
+      for j in range(lo,hi):
+        if j==me: continue
+        d2=dist2(px,py,xs[j],ys[j])
+        if d2<=200*200:
+          so=cs[j]+fs[j]
+          if so>sm: fo+=1
+          else: fr+=1
+      coin,_=self._nearest_coin(px,py,coins)
     in_store=rect_contains(self.store["x"],self.store["y"],self.store["w"],self.store["h"],px,py)
     in_rech =rect_contains(self.recharge["x"],self.recharge["y"],self.recharge["w"],self.recharge["h"],px,py)
     sx=self.store["x"]+self.store["w"]/2; sy=self.store["y"]+self.store["h"]/2
     rx=self.recharge["x"]+self.recharge["w"]/2; ry=self.recharge["y"]+self.recharge["h"]/2
-    return {"self":{"x":px,"y":py,"health":mep.get("health",100.0),"energy":mep.get("energy",100.0),
-                    "coins":mep.get("coins",0),"food":mep.get("food",0)},
-            "coin":coin,"in_store":in_store,"in_recharge":in_rech,
+    return {"self":{"x":px,"y":py,"health":v["health"][me],"energy":v["energy"][me],
+                    "coins":cs[me],"food":fs[me]},
+            "coin":coin,"crate":crate,"in_store":in_store,"in_recharge":in_rech,
             "store_c":(sx,sy),"rech_c":(rx,ry),"crowd":{"friends":fr,"foes":fo}}
 
   def _disc(self,obs):
     px=int(obs["self"]["x"]//128); py=int(obs["self"]["y"]//128)
     fr=obs["crowd"]["friends"]; fo=obs["crowd"]["foes"]; return (px,py,fr,fo)
 
-  def _policy(self,a,name,p,obs,coins):
-    px,py=p.get("x",0.0),p.get("y",0.0)
-    E=p.get("energy",100.0); H=p.get("health",100.0); C=p.get("coins",0); F=p.get("food",0)
+  def _policy(self,a,i,obs,coins):
+    me=obs["self"]; px,py=me["x"],me["y"]
+    E=me["energy"]; H=me["health"]; C=me["coins"]; F=me["food"]
     speed=155.0; ux=uy=0.0; beh="idle"
 
     need_store = (C>=FOOD_PRICE and (H<85 or E<70)) or (F>0 and (H<80 or E<80))
@@ -132,9 +554,9 @@ class Brain:
     elif coins and C<FOOD_PRICE: a=9
 
     if a==9 and coins:
-      coin,_=self._nearest_coin(px,py,coins)
+      coin=obs["coin"]
       if coin:
-        dx,dy=unit_towards(px,py,coin["x"],coin["y"]); ux,uy=dx*speed,dy*speed; beh="seek_coin"
+        dx,dy=unit_towards(px,py,coin[0],coin[1]); ux,uy=dx*speed,dy*speed; beh="seek_coin"
     elif a==10:
       sx,sy=obs["store_c"]; dx,dy=unit_towards(px,py,sx,sy); ux,uy=dx*speed,dy*speed; beh="go_store"
     elif a==11:
@@ -143,17 +565,15 @@ class Brain:
       dirs={1:(0,-1),2:(0,1),3:(-1,0),4:(1,0),5:(-1,-1),6:(1,-1),7:(-1,1),8:(1,1)}
       dx,dy=dirs[a]; ux,uy=dx*speed,dy*speed; beh="drift"
     elif a==14:
-      ang=self.agents[name].rng.random()*6.2831853; ux,uy=math.cos(ang)*speed,math.sin(ang)*speed; beh="wander"
+      ang=self.agents[self.names[i]].rng.random()*6.2831853; ux,uy=math.cos(ang)*speed,math.sin(ang)*speed; beh="wander"
     return ux,uy,beh
 
-  def _hud(self,name,p,beh):
-    return (f"{name} | H:{int(p.get('health',0))} E:{int(p.get('energy',0))} "
-            f"C:{int(p.get('coins',0))} F:{int(p.get('food',0))} "
-            f"P:{int(p.get('perf',0))} Act:{beh}")
-
 _BRAIN=Brain()
 def api_init(cfg): return json.dumps(_BRAIN.api_init(cfg))
-def api_tick(world): return json.dumps(_BRAIN.api_tick(world))
+def api_bind(views): _BRAIN.api_bind(views)
+def api_tick(tick,dt,n_coins): return _BRAIN.api_tick(tick,dt,n_coins)
 def api_reward(player,value,reason): return json.dumps(_BRAIN.api_reward(player,value,reason))
+def api_reward_batch(buf,n): _BRAIN.api_reward_batch(buf,n)
 def api_save(): return json.dumps(_BRAIN.api_save())
+def api_hud(i): return _BRAIN.api_hud(i)
 
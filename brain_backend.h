@@ -0,0 +1,102 @@
+// What a brain backend sees and implements: the frame buffers packed from the
+// worlds each tick, and the init/decide/reward/shutdown calls main.cpp makes.
+// PyBrain (pybrain.h) runs brain.py; NativeBrain (native_brain.h) is its C++ port.
+#pragma once
+
+#include "sim.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Snapshot of the agent arrays brain.py reads, packed from every world each
+// tick (world-major, so world w's agents are one contiguous slice). brain.py
+// sees them (and the coin arrays) as memoryviews, so nothing is formatted or
+// parsed per tick; it writes velocities/intents straight back.
+struct BridgeBuffers {
+  std::vector<float> x,y,vx,vy,health,energy,intel,perf;
+  std::vector<int32_t> coins,food;
+  std::vector<Coin> coinXY;        // all worlds' coins back to back
+  std::vector<int32_t> coinOff;    // world w's coins are coinXY[coinOff[w]..coinOff[w+1])
+  // World::Features of every agent: nearest coin/crate (x,y pairs; dist -1 = none),
+  // crate type, and friends/foes within 200 px.
+  std::vector<float> nearCoin,nearCoinDist,nearCrate,nearCrateDist;
+  std::vector<int32_t> nearCrateType,friends,foes;
+  std::vector<float> outVel;       // vx0,vy0,vx1,vy1,...
+  std::vector<int32_t> outIntent;  // index into INTENT_NAMES
+  void resize(size_t n,size_t worlds){
+    for(auto* v:{&x,&y,&vx,&vy,&health,&energy,&intel,&perf}) v->assign(n,0.0f);
+    coins.assign(n,0); food.assign(n,0);
+    coinXY.clear(); coinOff.assign(worlds+1,0);
+    for(auto* v:{&nearCoin,&nearCrate}) v->assign(2*n,0.0f);
+    for(auto* v:{&nearCoinDist,&nearCrateDist}) v->assign(n,-1.0f);
+    for(auto* v:{&nearCrateType,&friends,&foes}) v->assign(n,0);
+    outVel.assign(2*n,0.0f); outIntent.assign(n,0);
+  }
+  // Runs each world's observe() first (a no-op if the caller already did).
+  void pack(std::vector<World>& worlds){
+    size_t at=0;
+    coinXY.clear();
+    for(size_t w=0;w<worlds.size();++w){
+      worlds[w].observe();
+      const Agents& a=worlds[w].players;
+      const World::Features& f=worlds[w].feat;
+      auto put=[at](auto& dst,const auto& src,size_t k=1){ std::copy(src.begin(),src.end(),dst.begin()+k*at); };
+      put(x,a.x); put(y,a.y); put(vx,a.vx); put(vy,a.vy);
+      put(health,a.health); put(energy,a.energy); put(intel,a.intel); put(perf,a.perf);
+      put(coins,a.coins); put(food,a.food);
+      put(nearCoin,f.coinXY,2); put(nearCoinDist,f.coinDist); put(nearCrate,f.crateXY,2); put(nearCrateDist,f.crateDist);
+      put(nearCrateType,f.crateType); put(friends,f.friends); put(foes,f.foes);
+      coinOff[w]=(int32_t)coinXY.size();
+      coinXY.insert(coinXY.end(),worlds[w].coins.begin(),worlds[w].coins.end());
+      at+=a.size();
+    }
+    coinOff[worlds.size()]=(int32_t)coinXY.size();
+  }
+  // Visits the fixed-size input arrays (all but coinXY) as raw bytes, always in
+  // the same order; ShardedBrain lays its shared frame out this way.
+  template<class F> void each_input(F&& f){
+    for(auto* v:{&x,&y,&vx,&vy,&health,&energy,&intel,&perf,&nearCoin,&nearCoinDist,&nearCrate,&nearCrateDist})
+      f((void*)v->data(),v->size()*sizeof(float));
+    for(auto* v:{&coins,&food,&coinOff,&nearCrateType,&friends,&foes})
+      f((void*)v->data(),v->size()*sizeof(int32_t));
+  }
+  // Copies the inputs (not the outputs) of another frame.
+  void copy_inputs(const BridgeBuffers& o){
+    x=o.x; y=o.y; vx=o.vx; vy=o.vy;
+    health=o.health; energy=o.energy; intel=o.intel; perf=o.perf;
+    coins=o.coins; food=o.food; coinXY=o.coinXY; coinOff=o.coinOff;
+    nearCoin=o.nearCoin; nearCoinDist=o.nearCoinDist; nearCrate=o.nearCrate; nearCrateDist=o.nearCrateDist;
+    nearCrateType=o.nearCrateType; friends=o.friends; foes=o.foes;
+  }
+};
+static_assert(sizeof(Coin)==2*sizeof(float),"Coin is shared with brain.py as packed x,y floats");
+
+// The hover HUD line brain.py's api_hud returns, for backends and callers that
+// format it themselves. `intent` is an INTENT_NAMES index, -1 for none.
+inline void format_hud(std::string& out,const std::string& name,float health,float energy,
+                       int coins,int food,float perf,int intent){
+  char buf[160];
+  std::snprintf(buf,sizeof(buf),"%s | H:%d E:%d C:%d F:%d P:%d Act:%s",name.c_str(),
+                (int)health,(int)energy,coins,food,(int)perf,
+                intent>=0 && intent<INTENT_COUNT? INTENT_NAMES[intent] : "-");
+  out=buf;
+}
+
+struct BrainBackend {
+  BridgeBuffers io;                 // inputs packed by the caller, outputs written by decide()
+  bool fresh=false;                 // set before call_init: ignore saved state, start learning from scratch
+  bool persist=true;                // false: start empty and never read, write or delete saved state (parity runs)
+  virtual ~BrainBackend(){}
+  // `names` lists every world's agents, world-major, `worlds` equal slices.
+  virtual bool call_init(const std::vector<std::string>& names,size_t worlds)=0;
+  // Fills io.outVel/outIntent from whatever io currently holds.
+  virtual bool decide(int tick,float dt)=0;
+  // HUD text for one agent as of the last decide(), asked for only when it is
+  // shown (the agent under the mouse), never per tick. False if there is none.
+  virtual bool hud_line(size_t agent,std::string& out)=0;
+  // Delivers one batch of reward events, in order.
+  virtual void reward_batch(const RewardQueue& q)=0;
+  // Saves the learned state; false if that failed (the run then exits non-zero).
+  virtual bool shutdown()=0;
+};
@@ -0,0 +1,116 @@
+// Determinism checksums (--checksum FILE): a hash of every world's full state
+// after each tick, split by field, so two runs that should be identical (a
+// new code path against the old one, a replay against its recording) can be
+// compared tick for tick with checksum_compare.cpp.
+//
+// The trace is text, one line every --checksum-every ticks:
+//   tick T chain H all H x H y H ... rng H timers H
+// `all` hashes tick T's state, `chain` every tick's `all` up to T, so a
+// divergence between two written lines still shows in the next one. Floats
+// are hashed by bit pattern (so -0 and 0 differ), the RNG by its state words.
+#pragma once
+
+#include "sim.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+enum HashField : int {
+  HF_X, HF_Y, HF_VX, HF_VY, HF_HEALTH, HF_ENERGY, HF_INTEL, HF_BOOST, HF_PERF,
+  HF_COINS, HF_FOOD, HF_DEATHS, HF_INTENT, HF_STATUS, HF_COIN_XY, HF_CRATES, HF_RNG, HF_TIMERS,
+  HF_COUNT
+};
+static const char* const HASH_FIELD_NAMES[HF_COUNT]={
+  "x","y","vx","vy","health","energy","intel","boost","perf",
+  "coins","food","deaths","intent","status","coin_xy","crates","rng","timers"
+};
+
+// 64-bit FNV-1a over 32-bit words.
+struct Fnv {
+  uint64_t h=14695981039346656037ull;
+  void word(uint32_t w){ h=(h^w)*1099511628211ull; }
+  template<class T> void words(const T* p,size_t n){
+    static_assert(sizeof(T)%4==0,"hashed as 32-bit words");
+    const size_t k=n*sizeof(T)/4;
+    for(size_t i=0;i<k;++i){ uint32_t w; std::memcpy(&w,(const char*)p+4*i,4); word(w); }
+  }
+};
+
+struct StateHash {
+  uint64_t field[HF_COUNT]={};
+  uint64_t all=0;
+  bool operator==(const StateHash& o) const { return all==o.all && std::memcmp(field,o.field,sizeof field)==0; }
+};
+
+// Hashes every world in order; each field covers all worlds.
+static void hash_worlds(const std::vector<World>& worlds,StateHash& out){
+  Fnv f[HF_COUNT];
+  for(const World& w:worlds){
+    const Agents& a=w.players;
+    const size_t n=a.size();
+    f[HF_X].words(a.x.data(),n); f[HF_Y].words(a.y.data(),n);
+    f[HF_VX].words(a.vx.data(),n); f[HF_VY].words(a.vy.data(),n);
+    f[HF_HEALTH].words(a.health.data(),n); f[HF_ENERGY].words(a.energy.data(),n);
+    f[HF_INTEL].words(a.intel.data(),n); f[HF_BOOST].words(a.speedBoostT.data(),n);
+    f[HF_PERF].words(a.perf.data(),n);
+    f[HF_COINS].words(a.coins.data(),n); f[HF_FOOD].words(a.food.data(),n);
+    f[HF_DEATHS].words(a.deaths.data(),n); f[HF_INTENT].words(a.intent.data(),n);
+    for(const char* s:a.status){         // the text, not the pointer
+      f[HF_STATUS].word(s? (uint32_t)std::strlen(s) : 0xffffffffu);
+      if(s) for(;*s;++s) f[HF_STATUS].word((unsigned char)*s);
+    }
+    f[HF_COIN_XY].word((uint32_t)w.coins.size());
+    f[HF_COIN_XY].words(w.coins.items.data(),w.coins.size());
+    f[HF_CRATES].word((uint32_t)w.crates.size());
+    for(const Crate& c:w.crates){ f[HF_CRATES].words(&c.x,1); f[HF_CRATES].words(&c.y,1); f[HF_CRATES].word((uint32_t)c.t); }
+    // The engine's object layout differs between standard libraries; its next
+    // state_size outputs don't, and they pin down the whole state.
+    std::mt19937 r=w.rng;
+    for(size_t k=0;k<std::mt19937::state_size;++k) f[HF_RNG].word((uint32_t)r());
+    f[HF_TIMERS].words(&w.crateSpawnTimer,1);
+    const int64_t t=w.tick; f[HF_TIMERS].words(&t,1);
+  }
+  Fnv all;
+  for(int k=0;k<HF_COUNT;++k){ out.field[k]=f[k].h; all.words(&out.field[k],1); }
+  out.all=all.h;
+}
+
+// Writes the trace from the tick thread: tick() after every tick.
+struct ChecksumTrace {
+  std::FILE* f=nullptr;
+  long every=1, ticks=0, lastTick=0;
+  uint64_t chain=14695981039346656037ull;
+  StateHash last;
+
+  bool open(const char* path,long everyN,const std::string& setup){
+    f=std::fopen(path,"w");
+    if(!f){ std::perror(path); return false; }
+    every=std::max(1L,everyN);
+    std::fprintf(f,"# ecosys checksum v2 %s every=%ld\n",setup.c_str(),every);
+    return true;
+  }
+  void tick(long t,const std::vector<World>& worlds){
+    hash_worlds(worlds,last);
+    Fnv c; c.h=chain; c.words(&last.all,1); chain=c.h;
+    ++ticks; lastTick=t;
+    if(f && t%every==0) write_line();
+  }
+  // The last tick always gets a line, so runs of the same length end on one.
+  void close(){
+    if(!f) return;
+    if(ticks && lastTick%every) write_line();
+    std::fclose(f); f=nullptr;
+  }
+  ~ChecksumTrace(){ close(); }
+
+private:
+  void write_line(){
+    std::fprintf(f,"tick %ld chain %016llx all %016llx",lastTick,(unsigned long long)chain,(unsigned long long)last.all);
+    for(int k=0;k<HF_COUNT;++k) std::fprintf(f," %s %016llx",HASH_FIELD_NAMES[k],(unsigned long long)last.field[k]);
+    std::fputc('\n',f);
+  }
+};
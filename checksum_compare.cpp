@@ -0,0 +1,100 @@
+// Compares two checksum traces (--checksum FILE) and reports where the runs
+// first went apart: the first tick both traces wrote that differs, the last
+// one that still matched, and which state fields differ there.
+//
+// Built from the standard library alone:
+//   g++ -std=c++17 -O2 checksum_compare.cpp -o checksum_compare
+//   ./checksum_compare baseline.sum candidate.sum
+// Exit status 0 if the traces agree on every tick they share, 1 if they
+// diverge, 2 on bad usage or an unreadable trace.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct TraceLine {
+  long tick=0;
+  std::vector<std::pair<std::string,std::string>> kv;   // chain, all, then one hash per field
+  const std::string* get(const std::string& k) const {
+    for(const auto& p:kv) if(p.first==k) return &p.second;
+    return nullptr;
+  }
+};
+
+struct Trace {
+  std::string path, setup;   // header without every=, which may differ
+  std::vector<TraceLine> lines;
+
+  bool load(const char* p){
+    path=p;
+    std::ifstream in(p);
+    if(!in){ std::perror(p); return false; }
+    std::string l;
+    while(std::getline(in,l)){
+      if(l.empty()) continue;
+      if(l[0]=='#'){
+        setup=l.substr(0,l.find(" every="));
+        continue;
+      }
+      std::istringstream ss(l);
+      std::string k, v;
+      TraceLine t;
+      if(!(ss>>k>>t.tick) || k!="tick"){ std::fprintf(stderr,"%s: not a checksum trace\n",p); return false; }
+      while(ss>>k>>v) t.kv.emplace_back(k,v);
+      if(!t.get("chain") || !t.get("all")){ std::fprintf(stderr,"%s: not a checksum trace\n",p); return false; }
+      lines.push_back(std::move(t));
+    }
+    return true;
+  }
+};
+
+int main(int argc,char** argv){
+  if(argc!=3){
+    std::fprintf(stderr,"usage: %s TRACE_A TRACE_B\n  traces written by the app's --checksum FILE\n",argv[0]);
+    return 2;
+  }
+  Trace a, b;
+  if(!a.load(argv[1]) || !b.load(argv[2])) return 2;
+  if(a.setup!=b.setup)
+    std::printf("warning: the runs were set up differently\n  A %s\n  B %s\n",a.setup.c_str(),b.setup.c_str());
+
+  // Walk the ticks both traces wrote (they may use different --checksum-every).
+  size_t i=0, j=0, shared=0;
+  long lastMatch=0;
+  while(i<a.lines.size() && j<b.lines.size()){
+    const TraceLine& x=a.lines[i];
+    const TraceLine& y=b.lines[j];
+    if(x.tick<y.tick){ ++i; continue; }
+    if(y.tick<x.tick){ ++j; continue; }
+    ++shared;
+    if(*x.get("chain")==*y.get("chain")){ lastMatch=x.tick; ++i; ++j; continue; }
+
+    std::printf("diverged: first differing tick %ld",x.tick);
+    if(lastMatch) std::printf(" (last match at tick %ld)",lastMatch);
+    std::printf("\n");
+    if(x.tick-lastMatch>1)
+      std::printf("  the first difference is somewhere in ticks %ld..%ld; rerun both with --checksum-every 1 to pin it down\n",
+                  lastMatch+1,x.tick);
+    std::string fields;
+    for(const auto& p:x.kv){
+      if(p.first=="chain" || p.first=="all") continue;
+      const std::string* o=y.get(p.first);
+      if(!o || *o!=p.second) fields+=" "+p.first;
+    }
+    if(!fields.empty()) std::printf("  fields differing at tick %ld:%s\n",x.tick,fields.c_str());
+    else std::printf("  the state at tick %ld matches again; only an earlier tick differed\n",x.tick);
+    return 1;
+  }
+  if(!shared){
+    std::printf("no ticks in common (A: %zu lines, B: %zu lines)\n",a.lines.size(),b.lines.size());
+    return 1;
+  }
+  std::printf("identical: %zu shared checkpoints through tick %ld\n",shared,lastMatch);
+  const long endA=a.lines.empty()? 0 : a.lines.back().tick, endB=b.lines.empty()? 0 : b.lines.back().tick;
+  if(endA!=endB) std::printf("  (A ends at tick %ld, B at tick %ld)\n",endA,endB);
+  return 0;
+}
@@ -8,43 +8,37 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <cstdint>
+#include <cstddef>
 #include <string>
 #include <vector>
-#include <unordered_map>
 #include <optional>
+#include <memory>
 #include <sstream>
 #include <fstream>
 #include <cmath>
 #include <algorithm>
 #include <random>
+#include <chrono>
+#include <csignal>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 
-struct Texture { GLuint id=0; int w=0,h=0; };
-struct Rect { float x,y,w,h; };
-
-struct Player {
-  std::string name;
-  float x=0,y=0, vx=0,vy=0;
-  float health=100, energy=100;
-  int coins=0, food=0;
-  float intel=0, perf=0;
-  int deaths=0;
-  float speedBoostT=0.0f;
-  std::string hud, intent;
-  std::string status;
-};
-
-struct Coin { float x=0,y=0; };
+#include "sim.h"
+#include "pybrain.h"
+#include "native_brain.h"
+#ifdef __linux__
+#include "shard_brain.h"   // eventfd, prctl, /proc/self/exe: --brain-shards is Linux-only
+#endif
+#include "trajectory.h"
+#include "snapshot.h"
+#include "telemetry.h"
+#include "checksum.h"
+#include "alloc_count.h"
 
-enum class CrateType { Coins3, Food1, Speed8s, Heal30 };
-struct Crate { float x=0,y=0; CrateType t=CrateType::Coins3; };
-
-static const int WORLD_W=2048, WORLD_H=2048;
-static const Rect STORE    ={0,0,360,360};
-static const Rect RECHARGE ={WORLD_W-360.0f,0,360,360};
-
-static float clampf(float v,float lo,float hi){ return v<lo?lo:(v>hi?hi:v); }
-static bool in_rect(const Rect& r,float x,float y){ return x>=r.x&&x<=r.x+r.w&&y>=r.y&&y<=r.y+r.h; }
-static float dist2(float ax,float ay,float bx,float by){ float dx=ax-bx,dy=ay-by; return dx*dx+dy*dy; }
+struct Texture { GLuint id=0; int w=0,h=0; };
 
 static std::optional<Texture> tex_from_surface(SDL_Surface* s){
   if(!s) return std::nullopt;
@@ -69,202 +63,703 @@ static std::optional<Texture> load_texture(const std::string& path){
   SDL_FreeSurface(c);
   return t;
 }
-static Texture text_to_texture(TTF_Font* font,const std::string& txt,SDL_Color color){
-  Texture t;
-  if(!font || txt.empty()) return t;
-  SDL_Surface* s=TTF_RenderUTF8_Blended(font,txt.c_str(),color);
-  if(!s) return t;
-  SDL_Surface* c=SDL_ConvertSurfaceFormat(s,SDL_PIXELFORMAT_ABGR8888,0);
-  SDL_FreeSurface(s);
-  if(!c) return t;
-  auto to=tex_from_surface(c);
-  SDL_FreeSurface(c);
-  if(to) t=*to;
-  return t;
-}
-static void draw_textured_quad(const Texture& tex,float x,float y,float w,float h){
-  if(!tex.id) return;
-  glBindTexture(GL_TEXTURE_2D,tex.id);
-  glBegin(GL_QUADS);
-    glTexCoord2f(0,0); glVertex2f(x,y);
-    glTexCoord2f(1,0); glVertex2f(x+w,y);
-    glTexCoord2f(1,1); glVertex2f(x+w,y+h);
-    glTexCoord2f(0,1); glVertex2f(x,y+h);
-  glEnd();
-  glBindTexture(GL_TEXTURE_2D,0);
-}
-static void draw_filled_rect(float x,float y,float w,float h,float r,float g,float b,float a){
-  glDisable(GL_TEXTURE_2D);
-  glColor4f(r,g,b,a);
-  glBegin(GL_QUADS);
-    glVertex2f(x,y); glVertex2f(x+w,y);
-    glVertex2f(x+w,y+h); glVertex2f(x,y+h);
-  glEnd();
-  glColor4f(1,1,1,1);
-  glEnable(GL_TEXTURE_2D);
-}
 static void begin_ortho(float left,float right,float bottom,float top){
   glMatrixMode(GL_PROJECTION); glLoadIdentity(); glOrtho(left,right,bottom,top,-1,1);
   glMatrixMode(GL_MODELVIEW); glLoadIdentity();
 }
 
-static void draw_text_outlined(TTF_Font* font,const std::string& txt,
-                               SDL_Color fg, SDL_Color outline, float x,float y){
-  if(!font || txt.empty()) return;
-  Texture t_fg=text_to_texture(font,txt,fg);
-  Texture t_ol=text_to_texture(font,txt,outline);
-  if(!t_fg.id || !t_ol.id){
-    if(t_fg.id) glDeleteTextures(1,&t_fg.id);
-    if(t_ol.id) glDeleteTextures(1,&t_ol.id);
-    return;
+// Printable-ASCII glyph atlas for one font size, rasterised once at startup.
+// Every glyph is stored twice in white: plain, and grown by a TTF outline, so
+// outlined text is two tinted quads per glyph from a single texture.
+struct GlyphAtlas {
+  static constexpr int FIRST=32, COUNT=95;
+  struct Glyph { float u0=0,v0=0,u1=0,v1=0, w=0,h=0; };
+  Glyph fill[COUNT], edge[COUNT];
+  float adv[COUNT]={};
+  Texture tex;
+  float outline=0;
+
+  bool ok() const { return tex.id!=0; }
+  static int slot(unsigned char c){ return (c>=FIRST && c<FIRST+COUNT)? c-FIRST : '?'-FIRST; }
+  float measure(const std::string& txt) const {
+    float w=0; for(unsigned char c:txt) w+=adv[slot(c)]; return w;
+  }
+
+  bool build(const char* path,int ptsize,int outlinePx){
+    TTF_Font* f=TTF_OpenFont(path,ptsize);
+    TTF_Font* fo=TTF_OpenFont(path,ptsize);
+    if(!f||!fo){ if(f) TTF_CloseFont(f); if(fo) TTF_CloseFont(fo); return false; }
+    TTF_SetFontOutline(fo,outlinePx);
+    outline=(float)outlinePx;
+
+    const int atlasW=512, pad=2;
+    SDL_Color white={255,255,255,255};
+    SDL_Surface* gs[2][COUNT]={};
+    int gx[2][COUNT]={}, gy[2][COUNT]={};
+    int penX=pad, penY=pad, rowH=0;
+    for(int pass=0;pass<2;++pass){
+      for(int c=0;c<COUNT;++c){
+        SDL_Surface* g=TTF_RenderGlyph_Blended(pass?fo:f,(Uint16)(FIRST+c),white);
+        gs[pass][c]=g;
+        if(!g) continue;
+        if(penX+g->w+pad>atlasW){ penX=pad; penY+=rowH+pad; rowH=0; }
+        gx[pass][c]=penX; gy[pass][c]=penY;
+        penX+=g->w+pad; rowH=std::max(rowH,g->h);
+      }
+    }
+    for(int c=0;c<COUNT;++c){
+      int minx,maxx,miny,maxy,advance=0;
+      if(TTF_GlyphMetrics(f,(Uint16)(FIRST+c),&minx,&maxx,&miny,&maxy,&advance)==0) adv[c]=(float)advance;
+    }
+    int atlasH=64; while(atlasH<penY+rowH+pad) atlasH<<=1;
+
+    SDL_Surface* atlas=SDL_CreateRGBSurfaceWithFormat(0,atlasW,atlasH,32,SDL_PIXELFORMAT_ABGR8888);
+    if(atlas){
+      SDL_FillRect(atlas,nullptr,0);
+      for(int pass=0;pass<2;++pass){
+        for(int c=0;c<COUNT;++c){
+          SDL_Surface* g=gs[pass][c];
+          if(!g) continue;
+          SDL_SetSurfaceBlendMode(g,SDL_BLENDMODE_NONE);
+          SDL_Rect dst={gx[pass][c],gy[pass][c],g->w,g->h};
+          SDL_BlitSurface(g,nullptr,atlas,&dst);
+          Glyph& gl=(pass?edge:fill)[c];
+          gl.u0=(float)dst.x/atlasW; gl.v0=(float)dst.y/atlasH;
+          gl.u1=(float)(dst.x+g->w)/atlasW; gl.v1=(float)(dst.y+g->h)/atlasH;
+          gl.w=(float)g->w; gl.h=(float)g->h;
+        }
+      }
+      if(auto t=tex_from_surface(atlas)) tex=*t;
+      SDL_FreeSurface(atlas);
+    }
+    for(auto& row:gs) for(SDL_Surface* g:row) if(g) SDL_FreeSurface(g);
+    TTF_CloseFont(fo); TTF_CloseFont(f);
+    return ok();
   }
-  glBindTexture(GL_TEXTURE_2D, t_ol.id);
-  const float o=2.0f;
-  for(int dx=-1; dx<=1; ++dx){
-    for(int dy=-1; dy<=1; ++dy){
-      if(dx==0 && dy==0) continue;
-      float ox=x+dx*o, oy=y+dy*o;
-      glBegin(GL_QUADS);
-        glTexCoord2f(0,0); glVertex2f(ox,oy);
-        glTexCoord2f(1,0); glVertex2f(ox+t_ol.w,oy);
-        glTexCoord2f(1,1); glVertex2f(ox+t_ol.w,oy+t_ol.h);
-        glTexCoord2f(0,1); glVertex2f(ox,oy+t_ol.h);
-      glEnd();
+  void destroy(){ if(tex.id) glDeleteTextures(1,&tex.id); tex=Texture{}; }
+};
+
+// Streams quads through one VBO and draws each run of same-texture quads
+// with a single glDrawArrays (fixed-function arrays, so it works in the
+// compatibility context and on llvmpipe). Quads are staged on the CPU and
+// copied into a persistently mapped ring (GL_ARB_buffer_storage) split into
+// four fenced quarters; without buffer storage the VBO is orphaned and
+// refilled with glBufferSubData instead. Texture 0 draws untextured quads.
+// Call flush() before drawing anything that must appear above the batch.
+struct SpriteBatch {
+  struct Vertex { float x,y,u,v; Uint8 r,g,b,a; };
+  static constexpr size_t QUARTER=1<<16;       // vertices per ring quarter
+  static constexpr size_t CAP=4*QUARTER;
+  std::vector<Vertex> verts;
+  GLuint tex=0, vbo=0;
+  Vertex* ring=nullptr;                        // persistent mapping, if any
+  GLsync fences[4]={};
+  size_t head=0, quarter=0;
+
+  void init(){
+    verts.reserve(QUARTER);
+    glGenBuffers(1,&vbo);
+    glBindBuffer(GL_ARRAY_BUFFER,vbo);
+    if(GLEW_ARB_buffer_storage){
+      const GLbitfield fl=GL_MAP_WRITE_BIT|GL_MAP_PERSISTENT_BIT|GL_MAP_COHERENT_BIT;
+      glBufferStorage(GL_ARRAY_BUFFER,CAP*sizeof(Vertex),nullptr,fl);
+      ring=(Vertex*)glMapBufferRange(GL_ARRAY_BUFFER,0,CAP*sizeof(Vertex),fl);
     }
+    if(!ring) glBufferData(GL_ARRAY_BUFFER,CAP*sizeof(Vertex),nullptr,GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER,0);
   }
-  glBindTexture(GL_TEXTURE_2D, t_fg.id);
-  glBegin(GL_QUADS);
-    glTexCoord2f(0,0); glVertex2f(x,y);
-    glTexCoord2f(1,0); glVertex2f(x+t_fg.w,y);
-    glTexCoord2f(1,1); glVertex2f(x+t_fg.w,y+t_fg.h);
-    glTexCoord2f(0,1); glVertex2f(x,y+t_fg.h);
-  glEnd();
-  glBindTexture(GL_TEXTURE_2D,0);
-  glDeleteTextures(1,&t_fg.id);
-  glDeleteTextures(1,&t_ol.id);
+  void destroy(){
+    for(auto& f:fences) if(f){ glDeleteSync(f); f=nullptr; }
+    if(vbo){
+      if(ring){ glBindBuffer(GL_ARRAY_BUFFER,vbo); glUnmapBuffer(GL_ARRAY_BUFFER); glBindBuffer(GL_ARRAY_BUFFER,0); }
+      glDeleteBuffers(1,&vbo);
+    }
+    vbo=0; ring=nullptr;
+  }
+
+  void use(GLuint t){ if(tex!=t){ flush(); tex=t; } }
+  void quad(float x,float y,float w,float h,float u0,float v0,float u1,float v1,Uint8 r,Uint8 g,Uint8 b,Uint8 a){
+    verts.push_back({x,  y,  u0,v0,r,g,b,a});
+    verts.push_back({x+w,y,  u1,v0,r,g,b,a});
+    verts.push_back({x+w,y+h,u1,v1,r,g,b,a});
+    verts.push_back({x,  y+h,u0,v1,r,g,b,a});
+  }
+  void sprite(const Texture& t,float x,float y,float w,float h){
+    if(!t.id) return;
+    use(t.id); quad(x,y,w,h,0,0,1,1,255,255,255,255);
+  }
+  void rect(float x,float y,float w,float h,float r,float g,float b,float a){
+    use(0);
+    quad(x,y,w,h,0,0,0,0,(Uint8)(r*255.0f+0.5f),(Uint8)(g*255.0f+0.5f),(Uint8)(b*255.0f+0.5f),(Uint8)(a*255.0f+0.5f));
+  }
+
+  // Copies n vertices into the VBO and returns the index of the first one.
+  size_t upload(const Vertex* v,size_t n){
+    if(ring){
+      if(head+n>(quarter+1)*QUARTER){
+        fences[quarter]=glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE,0);
+        quarter=(quarter+1)%4; head=quarter*QUARTER;
+        if(GLsync f=fences[quarter]){
+          glClientWaitSync(f,GL_SYNC_FLUSH_COMMANDS_BIT,(GLuint64)1000000000);
+          glDeleteSync(f); fences[quarter]=nullptr;
+        }
+      }
+      std::memcpy(ring+head,v,n*sizeof(Vertex));
+    } else {
+      if(head+n>CAP){ glBufferData(GL_ARRAY_BUFFER,CAP*sizeof(Vertex),nullptr,GL_STREAM_DRAW); head=0; }
+      glBufferSubData(GL_ARRAY_BUFFER,(GLintptr)(head*sizeof(Vertex)),(GLsizeiptr)(n*sizeof(Vertex)),v);
+    }
+    size_t first=head; head+=n;
+    return first;
+  }
+  void flush(){
+    if(verts.empty() || !vbo){ verts.clear(); return; }
+    glBindBuffer(GL_ARRAY_BUFFER,vbo);
+    if(tex) glBindTexture(GL_TEXTURE_2D,tex); else glDisable(GL_TEXTURE_2D);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(2,GL_FLOAT,sizeof(Vertex),(const void*)offsetof(Vertex,x));
+    glTexCoordPointer(2,GL_FLOAT,sizeof(Vertex),(const void*)offsetof(Vertex,u));
+    glColorPointer(4,GL_UNSIGNED_BYTE,sizeof(Vertex),(const void*)offsetof(Vertex,r));
+    for(size_t off=0;off<verts.size();off+=QUARTER){   // QUARTER is a multiple of 4
+      size_t n=std::min(QUARTER,verts.size()-off);
+      size_t first=upload(verts.data()+off,n);
+      glDrawArrays(GL_QUADS,(GLint)first,(GLsizei)n);
+    }
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glColor4f(1,1,1,1);
+    if(tex) glBindTexture(GL_TEXTURE_2D,0); else glEnable(GL_TEXTURE_2D);
+    glBindBuffer(GL_ARRAY_BUFFER,0);
+    verts.clear();
+  }
+};
+
+static void draw_glyph(SpriteBatch& batch,const GlyphAtlas::Glyph& gl,float x,float y,SDL_Color c){
+  if(gl.w>0) batch.quad(x,y,gl.w,gl.h,gl.u0,gl.v0,gl.u1,gl.v1,c.r,c.g,c.b,c.a);
+}
+static void draw_text(const GlyphAtlas& atlas,SpriteBatch& batch,const std::string& txt,SDL_Color fg,float x,float y){
+  if(!atlas.ok() || txt.empty()) return;
+  batch.use(atlas.tex.id);
+  for(unsigned char c:txt){ int k=GlyphAtlas::slot(c); draw_glyph(batch,atlas.fill[k],x,y,fg); x+=atlas.adv[k]; }
+}
+static void draw_text_outlined(const GlyphAtlas& atlas,SpriteBatch& batch,const std::string& txt,
+                               SDL_Color fg, SDL_Color outline, float x,float y){
+  if(!atlas.ok() || txt.empty()) return;
+  batch.use(atlas.tex.id);
+  float ox=x;
+  for(unsigned char c:txt){ int k=GlyphAtlas::slot(c); draw_glyph(batch,atlas.edge[k],ox-atlas.outline,y-atlas.outline,outline); ox+=atlas.adv[k]; }
+  draw_text(atlas,batch,txt,fg,x,y);
 }
 
+// F1 stats panel: the top rows by perf, ranked with a partial sort and
+// formatted at most `hz` times a second. When FBOs are available the panel is
+// rasterised into a texture only when a row actually changed and is one quad
+// per frame otherwise; without them the cached rows are redrawn each frame.
+struct StatsPanel {
+  double hz=4.0;                    // <= 0: re-rank every frame
+  Uint64 lastRefresh=0;
+  std::vector<int32_t> order;
+  std::vector<std::string> rows, next;
+  Texture tex; GLuint fbo=0;
+  bool noFbo=false, drawn=false;
+
+  // Re-ranks when due and formats the top `k` rows; true if any row changed.
+  bool refresh(const Agents& a,size_t k){
+    const Uint64 now=SDL_GetPerformanceCounter();
+    if(hz>0.0 && lastRefresh && (double)(now-lastRefresh)<(double)SDL_GetPerformanceFrequency()/hz) return false;
+    lastRefresh=now;
+    order.resize(a.size());
+    for(size_t i=0;i<order.size();++i) order[i]=(int32_t)i;
+    k=std::min(k,order.size());
+    // Ties go to the lower index so equal rows don't swap places between refreshes.
+    std::partial_sort(order.begin(),order.begin()+k,order.end(),[&](int32_t x,int32_t y){
+      return a.perf[x]>a.perf[y] || (a.perf[x]==a.perf[y] && x<y);
+    });
+    next.resize(k);
+    for(size_t r=0;r<k;++r){
+      const size_t i=(size_t)order[r];
+      const std::string& name=a.name[i];
+      char buf[256];
+      int n=std::snprintf(buf,sizeof(buf),"%s%zu.  %s%*s %.0f  %.0f  %d  %d  %.0f  %.0f   %d   %s",
+                          r+1<10?"  ":" ",r+1,name.c_str(),name.size()<8?(int)(8-name.size()):1,"",
+                          a.health[i],a.energy[i],a.coins[i],a.food[i],a.intel[i],a.perf[i],a.deaths[i],
+                          a.intent[i]<0?"-":INTENT_NAMES[a.intent[i]]);
+      next[r].assign(buf,(size_t)std::clamp(n,0,(int)sizeof(buf)-1));
+      if(a.status[i]) next[r].append("  [").append(a.status[i]).append("]");
+    }
+    if(next==rows) return false;
+    rows.swap(next);
+    return true;
+  }
+  // (Re)creates the w x h render target; false if FBOs are unavailable.
+  bool target(int w,int h){
+    if(noFbo || w<=0 || h<=0) return false;
+    if(fbo && tex.w==w && tex.h==h) return true;
+    destroy();
+    if(!GLEW_ARB_framebuffer_object){ noFbo=true; return false; }
+    glGenTextures(1,&tex.id);
+    glBindTexture(GL_TEXTURE_2D,tex.id);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA8,w,h,0,GL_RGBA,GL_UNSIGNED_BYTE,nullptr);
+    glBindTexture(GL_TEXTURE_2D,0);
+    tex.w=w; tex.h=h;
+    glGenFramebuffers(1,&fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER,fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,GL_TEXTURE_2D,tex.id,0);
+    const bool ok=glCheckFramebufferStatus(GL_FRAMEBUFFER)==GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER,0);
+    if(!ok){ destroy(); noFbo=true; }
+    return ok;
+  }
+  void destroy(){
+    if(fbo) glDeleteFramebuffers(1,&fbo);
+    if(tex.id) glDeleteTextures(1,&tex.id);
+    fbo=0; tex=Texture(); drawn=false;
+  }
+};
+
+// At scale 1 the whole world fits the window, so bigger worlds may zoom in
+// further; the closest view is always about the same number of pixels across.
 struct Camera { float cx=0, cy=0, scale=1.0f; };
+static float max_zoom(){ return 6.0f*(float)std::max(WORLD_W,WORLD_H)/2048.0f; }
 static void screen_to_world(const Camera& cam,int w,int h,int mx,int my,float& wx,float& wy){
   float vw=WORLD_W/cam.scale, vh=WORLD_H/cam.scale;
   wx=cam.cx + (float(mx)/w)*vw; wy=cam.cy + (float(my)/h)*vh;
 }
 static void zoom_on_point(Camera& cam,float z,float ax,float ay){
   float before=cam.scale;
-  cam.scale=clampf(cam.scale*z,0.25f,6.0f);
+  cam.scale=clampf(cam.scale*z,0.25f,max_zoom());
   float s=cam.scale/before;
   cam.cx=ax-(ax-cam.cx)/s; cam.cy=ay-(ay-cam.cy)/s;
   cam.cx=clampf(cam.cx,0,WORLD_W-WORLD_W/cam.scale);
   cam.cy=clampf(cam.cy,0,WORLD_H-WORLD_H/cam.scale);
 }
 
-struct PyBrain {
-  PyObject* mod=nullptr,*api_init=nullptr,*api_tick=nullptr,*api_reward=nullptr,*api_save=nullptr;
-  PyObject* json_mod=nullptr,*json_loads=nullptr;
-  bool init(){
-    Py_Initialize();
-    if(!Py_IsInitialized()){ std::fprintf(stderr,"Py init fail\n"); return false; }
-    PyObject* sys_path=PySys_GetObject((char*)"path");
-    PyList_Append(sys_path,PyUnicode_FromString("."));
-    mod=PyImport_ImportModule("brain");
-    if(!mod){ PyErr_Print(); return false; }
-    api_init=PyObject_GetAttrString(mod,"api_init");
-    api_tick=PyObject_GetAttrString(mod,"api_tick");
-    api_reward=PyObject_GetAttrString(mod,"api_reward");
-    api_save=PyObject_GetAttrString(mod,"api_save");
-    if(!api_init||!api_tick||!api_reward||!api_save){ PyErr_Print(); return false; }
-    json_mod=PyImport_ImportModule("json");
-    if(!json_mod){ PyErr_Print(); return false; }
-    json_loads=PyObject_GetAttrString(json_mod,"loads");
-    if(!json_loads){ PyErr_Print(); return false; }
-    return true;
+enum BrainKind { BRAIN_PYTHON, BRAIN_NUMPY, BRAIN_NATIVE, BRAIN_PARITY };
+
+struct RunConfig {
+  bool headless=false;
+  long maxTicks=0;        // 0 = no tick budget
+  double maxSeconds=0.0;  // 0 = no wall-clock budget
+  int startCoins=0;
+  BrainKind brain=BRAIN_PYTHON;  // numpy: brain.py's batched engine; parity: brain.py drives, the native port runs beside it and is compared
+  bool freshBrain=false;  // start learning from scratch instead of the saved checkpoint
+  int asyncBrain=0;       // 0 = the brain runs inline; K = own thread, decisions up to K decisions old
+  int brainShards=1;      // > 1: brain.py runs in this many worker processes, agents split between them
+  int decideEvery=1;      // ask the brain every K ticks, holding its decisions in between
+  int worlds=1;           // independent worlds stepped side by side, one brain call per tick
+  int threads=0;          // 0 = one per world, capped at the core count
+  uint32_t seed=1337;     // world w uses seed+w
+  std::string recordPath; // append every tick to this trajectory log
+  std::string replayPath; // drive the worlds from this log instead of brain.py
+  std::string profileCsv; // per-tick phase timings
+  std::string telemetry;  // publish per-tick stats to this POSIX shared-memory segment
+  std::string checksumPath; // hash the full world state every tick, trace to this file
+  long checksumEvery=1;   // write every Nth tick's hashes to the trace
+  long allocCheck=0;      // > 0: count heap allocations in step() after this many warm-up ticks (headless)
+  double panelHz=4.0;     // stats panel refreshes per second; <= 0 every frame
+  int worldW=2048, worldH=2048;  // every world's size in px
+};
+
+static void usage(const char* argv0){
+  std::fprintf(stderr,
+    "usage: %s [--headless] [--ticks N] [--seconds S] [--coins N] [--brain python|numpy|native|parity]\n"
+    "          [--fresh-brain] [--brain-shards N] [--async-brain K] [--decide-every K] [--worlds M] [--threads T]\n"
+    "          [--seed S] [--record FILE | --replay FILE] [--profile-csv FILE] [--alloc-check W]\n"
+    "          [--panel-hz H] [--world WxH] [--telemetry NAME]\n"
+    "          [--checksum FILE] [--checksum-every N]\n"
+    "  --headless   no window/GL/fonts, run the fixed-step tick loop uncapped\n"
+    "  --ticks N    stop after N ticks (headless)\n"
+    "  --seconds S  stop after S wall-clock seconds (headless)\n"
+    "  --coins N    scatter N coins over the world at startup\n"
+    "  --brain B    python (brain.py, default), numpy (brain.py with every agent batched into NumPy\n"
+    "               arrays, for hundreds of agents), native (its C++ port, no interpreter in the tick)\n"
+    "               or parity (brain.py drives; the port is checked against it every tick)\n"
+    "  --fresh-brain  ignore (and replace) the saved brain state instead of resuming from it\n"
+    "  --brain-shards N  run brain.py in N worker processes, each deciding for a slice of the agents\n"
+    "  --async-brain K  run the brain on its own thread; apply decisions at most K decisions old\n"
+    "  --decide-every K  ask the brain every K ticks, holding velocities and batching rewards in between\n"
+    "  --worlds M   step M independent worlds in parallel (the window shows world 0)\n"
+    "  --threads T  worker threads for --worlds (default: one per world, up to the core count)\n"
+    "  --seed S     RNG seed of world 0; world w uses S+w (default 1337)\n"
+    "  --record FILE  log states, decisions, input and rewards of every tick\n"
+    "  --replay FILE  re-run a log without brain.py (worlds/seed/coins come from the log)\n"
+    "  --profile-csv FILE  write per-tick phase timings (ns) and print a summary at exit\n"
+    "  --alloc-check W  (headless) after W warm-up ticks, count C++ heap allocations made by\n"
+    "               each tick; exit status 3 if there were any\n"
+    "  --panel-hz H  re-rank and redraw the F1 stats panel at most H times a second (default 4, 0 = every frame)\n"
+    "  --world WxH  world size in px (default 2048x2048, each side 1024..65536)\n"
+    "  --telemetry NAME  publish per-tick population stats to shared memory NAME (e.g. /ecosys)\n"
+    "               for telemetry_reader or other tools\n"
+    "  --checksum FILE  hash every world's full state after each tick and write a trace\n"
+    "               (compare two with checksum_compare)\n"
+    "  --checksum-every N  write every Nth tick's hashes to the trace (default 1; the\n"
+    "               chained hash still covers every tick)\n", argv0);
+}
+
+static bool parse_args(int argc,char** argv,RunConfig& cfg){
+  for(int i=1;i<argc;++i){
+    std::string a=argv[i];
+    const char* v=(i+1<argc)? argv[i+1] : nullptr;
+    if(a=="--headless") cfg.headless=true;
+    else if(a=="--ticks"   && v){ cfg.maxTicks=std::atol(v); ++i; }
+    else if(a=="--seconds" && v){ cfg.maxSeconds=std::atof(v); ++i; }
+    else if(a=="--coins"   && v){ cfg.startCoins=std::max(0,std::atoi(v)); ++i; }
+    else if(a=="--brain" && v){
+      std::string b=v; ++i;
+      if(b=="python") cfg.brain=BRAIN_PYTHON;
+      else if(b=="numpy") cfg.brain=BRAIN_NUMPY;
+      else if(b=="native") cfg.brain=BRAIN_NATIVE;
+      else if(b=="parity") cfg.brain=BRAIN_PARITY;
+      else return false;
+    }
+    else if(a=="--fresh-brain") cfg.freshBrain=true;
+    else if(a=="--brain-shards" && v){
+#ifdef __linux__
+      cfg.brainShards=std::max(1,std::min(std::atoi(v),ShardHeader::MAX_SHARDS)); ++i;
+#else
+      std::fprintf(stderr,"--brain-shards is only available on Linux\n");
+      return false;
+#endif
+    }
+    else if(a=="--decide-every" && v){ cfg.decideEvery=std::max(1,std::atoi(v)); ++i; }
+    else if(a=="--async-brain" && v){ cfg.asyncBrain=std::max(1,std::atoi(v)); ++i; }
+    else if(a=="--worlds"  && v){ cfg.worlds=std::max(1,std::atoi(v)); ++i; }
+    else if(a=="--threads" && v){ cfg.threads=std::max(1,std::atoi(v)); ++i; }
+    else if(a=="--seed"    && v){ cfg.seed=(uint32_t)std::strtoul(v,nullptr,10); ++i; }
+    else if(a=="--record"  && v){ cfg.recordPath=v; ++i; }
+    else if(a=="--replay"  && v){ cfg.replayPath=v; ++i; }
+    else if(a=="--profile-csv" && v){ cfg.profileCsv=v; ++i; }
+    else if(a=="--telemetry" && v){ cfg.telemetry=v; ++i; }
+    else if(a=="--checksum" && v){ cfg.checksumPath=v; ++i; }
+    else if(a=="--checksum-every" && v){ cfg.checksumEvery=std::max(1L,std::atol(v)); ++i; }
+    else if(a=="--alloc-check" && v){ cfg.allocCheck=std::max(1L,std::atol(v)); ++i; }
+    else if(a=="--panel-hz" && v){ cfg.panelHz=std::atof(v); ++i; }
+    else if(a=="--world" && v){
+      if(std::sscanf(v,"%dx%d",&cfg.worldW,&cfg.worldH)!=2) return false;
+      if(std::min(cfg.worldW,cfg.worldH)<WORLD_MIN || std::max(cfg.worldW,cfg.worldH)>WORLD_MAX) return false;
+      ++i;
+    }
+    else return false;
   }
-  void shutdown(){
-    if(api_save){
-      PyObject* r=PyObject_CallFunction(api_save,nullptr);
-      Py_XDECREF(r);
-    }
-    Py_XDECREF(json_loads); Py_XDECREF(json_mod);
-    Py_XDECREF(api_save); Py_XDECREF(api_reward); Py_XDECREF(api_tick); Py_XDECREF(api_init);
-    Py_XDECREF(mod);
-    if(Py_IsInitialized()) Py_Finalize();
+  if(cfg.brain==BRAIN_PARITY && cfg.asyncBrain>0) return false;  // parity compares same-tick decisions
+  if(cfg.brain==BRAIN_NATIVE && cfg.brainShards>1) return false;  // shards are brain.py processes
+  return cfg.recordPath.empty() || cfg.replayPath.empty();
+}
+
+static volatile std::sig_atomic_t g_stop=0;
+static void on_sigint(int){ g_stop=1; }
+
+int main(int argc,char** argv){
+#ifdef __linux__
+  if(argc>1 && std::strcmp(argv[1],"--brain-worker")==0) return run_shard_worker(argc,argv);
+#endif
+  RunConfig cfg;
+  if(!parse_args(argc,argv,cfg)){ usage(argv[0]); return 2; }
+  set_world_size(cfg.worldW,cfg.worldH);
+
+  int agentsPerWorld=25;
+  std::optional<TrajReader> replay;
+  if(!cfg.replayPath.empty()){
+    replay.emplace();
+    if(!replay->open(cfg.replayPath.c_str())) return 1;
+    const TrajHeader& h=replay->hdr;
+    if(std::min(h.worldW,h.worldH)<WORLD_MIN || std::max(h.worldW,h.worldH)>WORLD_MAX
+       || h.dt!=World().dt || h.worlds<1 || h.agentsPerWorld<1){
+      std::fprintf(stderr,"%s: recorded with a different world setup (%dx%d)\n",cfg.replayPath.c_str(),h.worldW,h.worldH);
+      return 1;
+    }
+    set_world_size(h.worldW,h.worldH);
+    cfg.worlds=h.worlds; cfg.seed=h.seed; cfg.startCoins=h.startCoins; agentsPerWorld=h.agentsPerWorld;
+    cfg.asyncBrain=0;
   }
-  bool call_init(const std::vector<std::string>& names){
-    std::ostringstream ss;
-    ss<<"{\"bounds\":{\"w\":"<<WORLD_W<<",\"h\":"<<WORLD_H<<"},";
-    ss<<"\"store\":{\"x\":0,\"y\":0,\"w\":360,\"h\":360},";
-    ss<<"\"recharge\":{\"x\":"<<(WORLD_W-360)<<",\"y\":0,\"w\":360,\"h\":360},";
-    ss<<"\"players\":[";
-    for(size_t i=0;i<names.size();++i){
-      if(i) ss<<",";
-      ss<<"\""<<names[i]<<"\"";
-    }
-    ss<<"]}";
-    PyObject* arg=Py_BuildValue("(s)", ss.str().c_str());
-    PyObject* ret=PyObject_CallObject(api_init,arg);
-    Py_DECREF(arg);
-    if(!ret){ PyErr_Print(); return false; }
-    Py_DECREF(ret);
-    return true;
+
+  std::vector<World> worlds;
+  worlds.reserve(cfg.worlds);
+  for(int w=0;w<cfg.worlds;++w)
+    worlds.emplace_back(cfg.seed+(uint32_t)w,agentsPerWorld,cfg.startCoins,
+                        cfg.worlds>1? "w"+std::to_string(w)+"/" : std::string());
+  const size_t perWorld=worlds[0].players.size(), nAgents=perWorld*worlds.size();
+  int nThreads=cfg.threads>0? cfg.threads : (int)std::min<size_t>(worlds.size(),std::max(1u,std::thread::hardware_concurrency()));
+  WorkerPool pool(nThreads);
+
+  std::vector<std::string> names;
+  for(const World& w:worlds) names.insert(names.end(),w.players.name.begin(),w.players.name.end());
+
+  std::unique_ptr<BrainBackend> brain;
+  std::optional<NativeBrain> shadow;   // --brain parity: fed the same frames and rewards as brain.py
+  if(cfg.brain==BRAIN_NATIVE) brain=std::make_unique<NativeBrain>();
+#ifdef __linux__
+  else if(cfg.brainShards>1 && !replay){
+    auto sharded=std::make_unique<ShardedBrain>(cfg.brainShards);
+    sharded->batched=cfg.brain==BRAIN_NUMPY;
+    brain=std::move(sharded);
   }
-  bool tick_and_get_decisions(
-    int tick,float dt,const std::vector<Player>& players,const std::vector<Coin>& coins,
-    std::unordered_map<std::string,std::string>& outHUD,
-    std::unordered_map<std::string,std::pair<float,float>>& outVel,
-    std::unordered_map<std::string,std::string>& outIntent){
-    std::ostringstream ss;
-    ss<<"{\"tick\":"<<tick<<",\"dt\":"<<dt<<",\"bounds\":{\"w\":"<<WORLD_W<<",\"h\":"<<WORLD_H<<"},";
-    ss<<"\"store\":{\"x\":0,\"y\":0,\"w\":360,\"h\":360},";
-    ss<<"\"recharge\":{\"x\":"<<(WORLD_W-360)<<",\"y\":0,\"w\":360,\"h\":360},";
-    ss<<"\"coins\":[";
-    for(size_t i=0;i<coins.size();++i){
-      if(i) ss<<",";
-      ss<<"{\"x\":"<<coins[i].x<<",\"y\":"<<coins[i].y<<"}";
-    }
-    ss<<"],\"players\":{";
-    for(size_t i=0;i<players.size();++i){
-      const auto& p=players[i];
-      if(i) ss<<",";
-      ss<<"\""<<p.name<<"\":{";
-      ss<<"\"x\":"<<p.x<<",\"y\":"<<p.y<<",\"vx\":"<<p.vx<<",\"vy\":"<<p.vy<<",";
-      ss<<"\"health\":"<<p.health<<",\"energy\":"<<p.energy<<",";
-      ss<<"\"coins\":"<<p.coins<<",\"food\":"<<p.food<<",";
-      ss<<"\"intel\":"<<p.intel<<",\"perf\":"<<p.perf<<"}";
-    }
-    ss<<"}}";
-    PyObject* arg=Py_BuildValue("(s)", ss.str().c_str());
-    PyObject* retStr=PyObject_CallObject(api_tick,arg);
-    Py_DECREF(arg);
-    if(!retStr){ PyErr_Print(); return false; }
-    PyObject* parsed=PyObject_CallFunction(json_loads,"O",retStr);
-    Py_DECREF(retStr);
-    if(!parsed){ PyErr_Print(); return false; }
-    PyObject* ok=PyDict_GetItemString(parsed,"ok");
-    if(!ok||!PyObject_IsTrue(ok)){ Py_DECREF(parsed); return false; }
-    PyObject* decisions=PyDict_GetItemString(parsed,"decisions");
-    if(!decisions||!PyDict_Check(decisions)){ Py_DECREF(parsed); return false; }
-    PyObject *k,*v; Py_ssize_t pos=0;
-    while(PyDict_Next(decisions,&pos,&k,&v)){
-      std::string name = PyUnicode_Check(k)? std::string(PyUnicode_AsUTF8(k)) : "";
-      if(name.empty()) continue;
-      PyObject* vx=PyDict_GetItemString(v,"vx");
-      PyObject* vy=PyDict_GetItemString(v,"vy");
-      PyObject* hud=PyDict_GetItemString(v,"hud");
-      PyObject* intent=PyDict_GetItemString(v,"intent");
-      outVel[name] = { vx? (float)PyFloat_AsDouble(vx):0.0f, vy? (float)PyFloat_AsDouble(vy):0.0f };
-      outHUD[name] = hud? std::string(PyUnicode_AsUTF8(hud)) : "";
-      outIntent[name] = intent? std::string(PyUnicode_AsUTF8(intent)) : "";
-    }
-    Py_DECREF(parsed);
-    return true;
+#endif
+  else {
+    auto py=std::make_unique<PyBrain>();
+    py->batched=cfg.brain==BRAIN_NUMPY;
+    if(!replay && !py->init()){ std::fprintf(stderr,"Python bridge init failed\n"); return 1; }
+    brain=std::move(py);
   }
-  void reward(const std::string& player,double value,const std::string& reason){
-    PyObject* r=PyObject_CallFunction(api_reward,"sds",player.c_str(),value,reason.c_str());
-    Py_XDECREF(r);
+  // Parity needs both learners to start from the same (empty) tables. They
+  // learn nothing worth keeping, so neither touches the saved state.
+  if(cfg.brain==BRAIN_PARITY && !replay){ shadow.emplace(); shadow->persist=false; shadow->call_init(names,worlds.size()); }
+  brain->fresh=cfg.freshBrain;
+  brain->persist=cfg.brain!=BRAIN_PARITY;
+  if(!replay && !brain->call_init(names,worlds.size())){ std::fprintf(stderr,"brain init failed\n"); return 1; }
+  std::optional<BrainPipeline> pipe;
+  if(cfg.asyncBrain>0){ pipe.emplace(*brain,cfg.asyncBrain,nAgents,worlds.size(),cfg.decideEvery); pipe->start(); }
+
+  const double dt=worlds[0].dt; int tick=0;
+  RewardQueue rewards; rewards.ev.reserve(1024);
+
+  Profiler prof;
+  if(!cfg.profileCsv.empty() && !prof.open_csv(cfg.profileCsv.c_str())) return 1;
+  // Folds the per-world advance() timings (CPU time, summed over worlds) in.
+  auto drain_world_phases=[&](){
+    for(World& w:worlds)
+      for(int p=0;p<PH_SIM_COUNT;++p){ prof.add((Phase)p,w.phaseNs[p]); w.phaseNs[p]=0; }
+  };
+
+  std::optional<TrajWriter> recorder;
+  std::vector<TrajEvent> inputs;   // user input since the last step, logged with it
+  if(!cfg.recordPath.empty()){
+    TrajHeader h;
+    h.seed=cfg.seed; h.worlds=(int32_t)worlds.size(); h.agentsPerWorld=(int32_t)perWorld;
+    h.startCoins=cfg.startCoins; h.dt=dt;
+    recorder.emplace();
+    if(!recorder->open(cfg.recordPath.c_str(),h)) return 1;
+  }
+  std::optional<TelemetryWriter> telemetry;
+  if(!cfg.telemetry.empty()){
+    telemetry.emplace();
+    if(!telemetry->open(cfg.telemetry,names,worlds.size(),dt)) return 1;
+  }
+  std::optional<ChecksumTrace> checksum;
+  if(!cfg.checksumPath.empty()){
+    char setup[160];
+    std::snprintf(setup,sizeof setup,"worlds=%zu agents=%zu seed=%u coins=%d world=%dx%d",
+                  worlds.size(),perWorld,cfg.seed,cfg.startCoins,WORLD_W,WORLD_H);
+    checksum.emplace();
+    if(!checksum->open(cfg.checksumPath.c_str(),cfg.checksumEvery,setup)) return 1;
+  }
+  auto apply_input=[&](const TrajEvent& ev){
+    if(ev.world<0 || (size_t)ev.world>=worlds.size()) return;
+    if(ev.kind==EV_DROP_COIN) worlds[ev.world].drop_coin(ev.x,ev.y);
+    else if(ev.kind==EV_SPAWN_CRATE) worlds[ev.world].spawn_crate(ev.x,ev.y);
+    if(recorder) inputs.push_back(ev);
+  };
+
+  // Replay: the logged input and decisions stand in for the brain, and the
+  // resulting state is compared with the logged one.
+  std::vector<float> replayVel(2*nAgents);
+  std::vector<int32_t> replayIntent(nAgents);
+  bool replayDone=false;
+  long replayDiverged=0, firstDivergence=0;
+  auto replay_step=[&](){
+    TrajReader::Tick t;
+    if(!replay->next(t)){ replayDone=true; return; }
+    ++tick;
+    for(uint32_t e=0;e<t.t->nEvents;++e) apply_input(t.events[e]);
+    for(World& w:worlds) w.begin_tick();
+    for(size_t k=0;k<nAgents;++k){
+      replayVel[2*k]=t.agents[k].outVx; replayVel[2*k+1]=t.agents[k].outVy;
+      replayIntent[k]=t.agents[k].intent;
+    }
+    pool.run(worlds.size(),[&](size_t w){
+      size_t at=w*perWorld;
+      worlds[w].advance(replayVel.data()+2*at,replayIntent.data()+at,t.t->decided!=0);
+    });
+    if(telemetry || checksum){
+      PhaseTimer pt(prof,PH_RECORD);
+      if(telemetry) telemetry->publish(tick,worlds);
+      if(checksum) checksum->tick(tick,worlds);
+    }
+    bool same=true;
+    const TrajAgent* r=t.agents;
+    for(size_t w=0;w<worlds.size();++w){
+      const Agents& a=worlds[w].players;
+      worlds[w].rewards.clear();
+      same = same && worlds[w].coins.size()==t.coinCount[w] && worlds[w].crates.size()==t.crateCount[w];
+      for(size_t i=0;i<a.size();++i,++r)
+        same = same && a.x[i]==r->x && a.y[i]==r->y && a.health[i]==r->health && a.energy[i]==r->energy
+                    && a.coins[i]==r->coins && a.food[i]==r->food && a.deaths[i]==r->deaths;
+    }
+    if(!same && !replayDiverged++) firstDivergence=tick;
+    drain_world_phases();
+    prof.commit_tick(tick);
+  };
+
+  // --brain parity: the port decides on brain.py's frame (untimed) and every
+  // agent's velocity and intent must match bit for bit.
+  long parityTicks=0, parityMismatches=0; int parityFirstTick=0; size_t parityFirstAgent=0;
+  auto check_parity=[&](){
+    shadow->io.copy_inputs(brain->io);
+    shadow->decide(tick,(float)dt);
+    ++parityTicks;
+    for(size_t k=0;k<nAgents;++k){
+      bool same=shadow->io.outIntent[k]==brain->io.outIntent[k]
+             && shadow->io.outVel[2*k]==brain->io.outVel[2*k] && shadow->io.outVel[2*k+1]==brain->io.outVel[2*k+1];
+      if(!same && !parityMismatches++){ parityFirstTick=tick; parityFirstAgent=k; }
+    }
+  };
+
+  // Gathers every world's rewards into one batch, agent indices made global.
+  auto gather_rewards=[&](){
+    int32_t off=0;
+    for(World& w:worlds){
+      rewards.append(w.rewards,off);
+      w.rewards.clear();
+      off+=(int32_t)w.players.size();
+    }
+  };
+
+  // Decisions in force; they outlive a step when --decide-every holds them.
+  const float* outVel=nullptr; const int32_t* outIntent=nullptr;
+  bool decided=false;
+
+  // One fixed step of every world. Shared by the windowed and headless loops,
+  // so it must not touch SDL/GL. All worlds' agents go to the brain in one
+  // call; the worlds then advance in parallel on the pool.
+  auto step=[&](){
+    if(replay){ replay_step(); return; }
+    ++tick;
+    for(World& w:worlds) w.begin_tick();
+
+    // The brain is asked every decideEvery ticks; in between the worlds keep
+    // stepping at dt with the last decisions held.
+    if((tick-1)%cfg.decideEvery==0){
+      // Per-agent features for the brain (timed per world as "features").
+      pool.run(worlds.size(),[&](size_t w){ worlds[w].observe(); });
+      const float decisionDt=(float)(dt*cfg.decideEvery);
+      if(pipe){
+        { PhaseTimer t(prof,PH_BRIDGE); pipe->submit(tick,decisionDt,worlds,rewards); }
+        PhaseTimer t(prof,PH_BRAIN);  // time spent waiting on the brain thread
+        const BrainPipeline::Decisions& d=pipe->acquire(tick);
+        decided=d.ok; outVel=d.vel.data(); outIntent=d.intent.data();
+      } else {
+        { PhaseTimer t(prof,PH_BRIDGE); brain->io.pack(worlds); }
+        { PhaseTimer t(prof,PH_BRAIN); decided=brain->decide(tick,decisionDt); }
+        outVel=brain->io.outVel.data(); outIntent=brain->io.outIntent.data();
+        if(shadow && decided) check_parity();
+      }
+    }
+
+    pool.run(worlds.size(),[&](size_t w){
+      size_t at=w*perWorld;
+      worlds[w].advance(outVel+2*at,outIntent+at,decided);
+    });
+    drain_world_phases();
+
+    if(recorder || telemetry || checksum){
+      PhaseTimer t(prof,PH_RECORD);
+      if(recorder){ recorder->record(tick,worlds,outVel,outIntent,decided,inputs); inputs.clear(); }
+      if(telemetry) telemetry->publish(tick,worlds);
+      if(checksum) checksum->tick(tick,worlds);
+    }
+
+    // Rewards pile up until the decision they belong to is over, then go out
+    // in one batch; with the pipeline they travel with the next snapshot.
+    {
+      PhaseTimer t(prof,PH_REWARDS);
+      gather_rewards();
+      if(!pipe && tick%cfg.decideEvery==0){
+        brain->reward_batch(rewards);
+        if(shadow) shadow->reward_batch(rewards);
+        rewards.clear();
+      }
+    }
+    prof.commit_tick(tick);
+  };
+
+  // False if the brain could not save what it learned.
+  auto finish_run=[&]()->bool{
+    if(prof.csv){
+      prof.close_csv();
+      std::printf("phase timings (us/tick over the last %d ticks) written per tick to %s\n",prof.filled[0],cfg.profileCsv.c_str());
+      for(int p=0;p<PH_SIM_COUNT;++p){
+        Profiler::Stats st=prof.stats((Phase)p);
+        std::printf("  %-18s min %9.1f  avg %9.1f  p99 %9.1f\n",PHASE_NAMES[p],st.minUs,st.avgUs,st.p99Us);
+      }
+    }
+    if(telemetry) telemetry->close();
+    if(checksum){
+      checksum->close();
+      std::printf("checksum: %ld ticks, chain %016llx, trace in %s\n",checksum->ticks,
+                  (unsigned long long)checksum->chain,cfg.checksumPath.c_str());
+    }
+    if(recorder){ recorder->close(); std::printf("recorded %llu ticks to %s\n",(unsigned long long)recorder->hdr.ticks,cfg.recordPath.c_str()); }
+    if(replay){
+      if(replayDiverged) std::printf("replay: %d ticks, %ld diverged from the log (first at tick %ld)\n",tick,replayDiverged,firstDivergence);
+      else std::printf("replay: %d ticks, all match the log\n",tick);
+      return true;
+    }
+    if(pipe){ pipe->stop(); pipe->report(); }
+    if(shadow){
+      if(parityMismatches) std::printf("brain parity: %ld ticks, %ld agent decisions differ (first: tick %d, %s)\n",
+                                       parityTicks,parityMismatches,parityFirstTick,names[parityFirstAgent].c_str());
+      else std::printf("brain parity: %ld ticks x %zu agents, native and brain.py decisions all match\n",parityTicks,nAgents);
+    }
+    gather_rewards();
+    brain->reward_batch(rewards);
+    rewards.clear();
+    if(brain->shutdown()) return true;
+    std::fprintf(stderr,"the brain's state could not be saved\n");
+    return false;
+  };
+
+  if(cfg.headless){
+    std::signal(SIGINT,on_sigint);
+    std::signal(SIGTERM,on_sigint);
+    using clock=std::chrono::steady_clock;
+    auto t0=clock::now();
+    long ran=0; double secs=0.0;
+    uint64_t allocs=0; long allocTicks=0, checkedTicks=0; int firstAllocTick=0;
+    while(!g_stop && !replayDone){
+      if(cfg.maxTicks>0 && ran>=cfg.maxTicks) break;
+      if(cfg.maxSeconds>0.0 && (ran&63)==0){
+        secs=std::chrono::duration<double>(clock::now()-t0).count();
+        if(secs>=cfg.maxSeconds) break;
+      }
+      const uint64_t before=g_heapAllocs.load(std::memory_order_relaxed);
+      step();
+      if(replayDone) break;
+      if(cfg.allocCheck>0 && ran>=cfg.allocCheck){
+        const uint64_t n=g_heapAllocs.load(std::memory_order_relaxed)-before;
+        ++checkedTicks;
+        if(n){ allocs+=n; if(!allocTicks++) firstAllocTick=tick; }
+      }
+      ++ran;
+    }
+    secs=std::chrono::duration<double>(clock::now()-t0).count();
+    double tps = secs>0.0? ran/secs : 0.0;
+    size_t nCoins=0, nCrates=0;
+    for(const World& w:worlds){ nCoins+=w.coins.size(); nCrates+=w.crates.size(); }
+    std::printf("headless: %ld ticks in %.3fs = %.1f ticks/s (%.1fx realtime), %zu coins, %zu crates left\n",
+                ran, secs, tps, tps*dt, nCoins, nCrates);
+    if(worlds.size()>1)
+      std::printf("headless: %zu worlds on %zu threads, %zu agents, %.0f agent-steps/s\n",
+                  worlds.size(), pool.size(), nAgents, tps*nAgents);
+    const bool saved=finish_run();
+    if(cfg.allocCheck>0){
+      if(allocs) std::printf("alloc-check: %llu heap allocations in %ld of %ld ticks after warm-up (first at tick %d)\n",
+                             (unsigned long long)allocs,allocTicks,checkedTicks,firstAllocTick);
+      else std::printf("alloc-check: no heap allocations in %ld ticks after %ld warm-up ticks\n",checkedTicks,cfg.allocCheck);
+      if(allocs) return 3;
+    }
+    return saved? 0 : 1;
   }
-};
 
-int main(int,char**){
+  // The window shows and edits world 0. From here on the worlds step on their
+  // own thread (started below), which hands world 0 over as snapshots; the
+  // render loop never reads the worlds themselves.
+  World& view=worlds[0];
+
   if(SDL_Init(SDL_INIT_VIDEO|SDL_INIT_TIMER)!=0){ std::fprintf(stderr,"SDL_Init: %s\n",SDL_GetError()); return 1; }
   if(IMG_Init(IMG_INIT_PNG)==0){ std::fprintf(stderr,"IMG_Init: %s\n",IMG_GetError()); return 1; }
   if(TTF_Init()!=0){ std::fprintf(stderr,"TTF_Init: %s\n",TTF_GetError()); return 1; }
@@ -289,118 +784,92 @@ int main(int,char**){
   if(!playerTex) std::fprintf(stderr,"Missing images/player.png\n");
   if(!coinTex)   std::fprintf(stderr,"Missing images/coin.png\n");
 
-  TTF_Font* font=TTF_OpenFont("DejaVuSans.ttf",20);
-  TTF_Font* fontSmall=TTF_OpenFont("DejaVuSans.ttf",19);
-  if(!font||!fontSmall) std::fprintf(stderr,"TTF_OpenFont failed: %s\n",TTF_GetError());
+  GlyphAtlas font, fontSmall;
+  if(!font.build("DejaVuSans.ttf",20,2) || !fontSmall.build("DejaVuSans.ttf",19,2))
+    std::fprintf(stderr,"Glyph atlas from DejaVuSans.ttf failed: %s\n",TTF_GetError());
+  SpriteBatch batch; batch.init();
   SDL_Color hudColor={255,255,255,255};
+  std::vector<int32_t> hovered; std::string hudLine;
+  StatsPanel panel; panel.hz=cfg.panelHz;
   SDL_Color neonGreen={80,255,120,255};
   SDL_Color neonTitle={0,255,60,255};
   SDL_Color outlineCol={0,0,0,255}; 
   SDL_Color zoneLabel={255,255,255,255};
 
-  std::vector<Player> players; players.reserve(25);
-  for(int i=0;i<25;++i){
-    Player p; p.name="Player"+std::to_string(i+1);
-    int cols=5; float gx=(i%cols), gy=(i/cols);
-    p.x=200.0f + gx*((WORLD_W-400.0f)/(cols-1));
-    p.y=300.0f + gy*((WORLD_H-600.0f)/((25/cols)-1 + ((25%cols)?1:0)));
-    players.push_back(p);
-  }
-  std::vector<Coin> coins;
-  std::vector<Crate> crates;
-
-  std::mt19937 rng(1337);
-  auto randf=[&](float a,float b){ std::uniform_real_distribution<float> d(a,b); return d(rng); };
-  auto randi=[&](int a,int b){ std::uniform_int_distribution<int> d(a,b); return d(rng); };
-  double crateSpawnTimer = 10.0; 
-
-  PyBrain brain;
-  if(!brain.init()){ std::fprintf(stderr,"Python bridge init failed\n"); return 1; }
-  { std::vector<std::string> names; names.reserve(players.size());
-    for(auto& p:players) names.push_back(p.name);
-    brain.call_init(names);
-  }
-
   Camera cam; cam.scale=0.75f;
 
-  bool running=true, rightDragging=false, showStatsPanel=true;
+  bool running=true, rightDragging=false, showStatsPanel=true, showProfiler=false;
   int lastMouseX=0,lastMouseY=0, mouseX=0,mouseY=0;
-  Uint64 prev=SDL_GetPerformanceCounter(); double acc=0.0; const double dt=1.0/60.0; int tick=0;
 
-  auto gain_intel=[&](Player& p,float amount){ p.intel=clampf(p.intel+amount,0.0f,100.0f); };
+  // Sim thread <-> window. Input events and the agents under the mouse go to
+  // the sim under simM (a handful per frame); world 0 comes back through
+  // `snaps` without locks. The brain is only ever called from the sim thread.
+  TripleBuffer<WorldSnapshot> snaps;
+  std::mutex simM;
+  std::vector<TrajEvent> queuedInput;   // guarded by simM
+  std::vector<int32_t> wantHud;         // guarded by simM
+  std::atomic<bool> simRun{true}, wantStats{false};
+  std::vector<float> prevX, prevY;      // sim thread: world 0's positions before the last tick
+  std::vector<int32_t> hudAgents;       // sim thread: its copy of wantHud
+  Profiler frameProf;                   // render phases; `prof` belongs to the sim thread
 
-  auto apply_transactions=[&](Player& p){
-    if(in_rect(STORE,p.x,p.y)){
-      int reserve = std::min(3, 1 + (int)std::floor(p.intel / 40.0f));
-      if(p.coins>=5 && p.food < reserve){
-        p.coins -= 5; p.food += 1; gain_intel(p, 0.5f);
-        brain.reward(p.name, +0.8, "buy_food_reserve");
-      }
-      bool lowHealth = (p.health <= 70.0f);
-      bool lowEnergy = (p.energy <= 60.0f);
-      if(p.food>0 && (lowHealth || lowEnergy)){
-        p.food -= 1;
-        p.health = clampf(p.health + 25.0f, 0, 100);
-        p.energy = clampf(p.energy + 20.0f, 0, 100);
-        gain_intel(p, 0.5f);
-        brain.reward(p.name, +1.0, "eat_food_delayed");
-      }
-    }
-    if(in_rect(RECHARGE,p.x,p.y)){
-      float before=p.energy;
-      p.energy=clampf(p.energy + 30.0f*(float)dt, 0, 100);
-      if(p.energy>before) brain.reward(p.name, +0.2, "recharge");
-    }
-    if(p.food >= 1 && p.health > 70.0f && p.energy > 60.0f){
-      brain.reward(p.name, +0.02, "maintain_food_reserve");
+  auto take_snapshot=[&](){
+    WorldSnapshot& s=snaps.back();
+    s.take(view,prevX,prevY);
+    s.hudAgent=hudAgents; s.hudText.resize(hudAgents.size());
+    for(size_t k=0;k<hudAgents.size();++k){
+      const size_t i=(size_t)hudAgents[k];
+      std::string& line=s.hudText[k];
+      Player p(view.players,i);
+      bool ok = pipe? pipe->hud_line(i,line) : (!replay && brain->hud_line(i,line));
+      if(!ok) format_hud(line,p.name,p.health,p.energy,p.coins,p.food,p.perf,p.intent);
+      if(p.status) line.append(" [").append(p.status).append("]");
     }
+    s.hasStats=wantStats.load(std::memory_order_relaxed);
+    if(s.hasStats) for(int p=0;p<PH_SIM_COUNT;++p) s.simStats[p]=prof.stats((Phase)p);
+    snaps.publish();
   };
+  prevX=view.players.x; prevY=view.players.y;
+  take_snapshot();
 
-  auto collect_coins=[&](Player& p){
-    for(size_t i=0;i<coins.size();){
-      if(dist2(p.x,p.y,coins[i].x,coins[i].y) <= 40.0f*40.0f){
-        coins.erase(coins.begin()+i);
-        p.coins += 1; p.perf+=0.5f; gain_intel(p, 0.25f);
-        brain.reward(p.name, +1.0, "collect_coin");
-      } else {
-        ++i;
+  // Fixed-step sim at real time: input queued since the last pass first, then
+  // as many ticks as are due, then one snapshot of where that left world 0.
+  std::thread simThread([&]{
+    using clock=std::chrono::steady_clock;
+    auto prev=clock::now(); double acc=0.0;
+    std::vector<TrajEvent> events;
+    while(simRun.load(std::memory_order_acquire)){
+      auto now=clock::now();
+      double elapsed=std::chrono::duration<double>(now-prev).count();
+      if(elapsed>0.25) elapsed=0.25;
+      prev=now; acc+=elapsed;
+      if(acc<dt){ std::this_thread::sleep_for(std::chrono::duration<double>(dt-acc)); continue; }
+      {
+        std::lock_guard<std::mutex> lk(simM);
+        events.swap(queuedInput);
+        hudAgents.assign(wantHud.begin(),wantHud.end());
       }
-    }
-  };
-
-  auto collect_crates=[&](Player& p){
-    for(size_t i=0;i<crates.size();){
-      if(dist2(p.x,p.y,crates[i].x,crates[i].y) <= 45.0f*45.0f){
-        CrateType t = crates[i].t;
-        crates.erase(crates.begin()+i);
-        switch(t){
-          case CrateType::Coins3:
-            p.coins += 3; p.perf += 1.0f; p.status="CRATE: +3 coins";
-            brain.reward(p.name, +1.2, "crate_coins3");
-            break;
-          case CrateType::Food1:
-            p.food = std::min(p.food+1, 9); p.perf += 0.8f; p.status="CRATE: +1 food";
-            brain.reward(p.name, +1.0, "crate_food1");
-            break;
-          case CrateType::Speed8s:
-            p.speedBoostT = std::max(p.speedBoostT, 8.0f); p.perf += 0.8f; p.status="CRATE: speed x1.5 (8s)";
-            brain.reward(p.name, +0.8, "crate_speed");
-            break;
-          case CrateType::Heal30:
-            p.health = clampf(p.health + 30.0f, 0, 100); p.perf += 0.8f; p.status="CRATE: +30 health";
-            brain.reward(p.name, +0.8, "crate_heal30");
-            break;
-        }
-      } else {
-        ++i;
+      for(const TrajEvent& ev:events) apply_input(ev);
+      events.clear();
+      if(pipe) pipe->want_hud(hudAgents);
+      while(acc>=dt){
+        prevX=view.players.x; prevY=view.players.y;
+        step();
+        acc-=dt;
       }
+      take_snapshot();
     }
+  });
+  auto queue_input=[&](const TrajEvent& ev){
+    if(replay) return;
+    std::lock_guard<std::mutex> lk(simM);
+    queuedInput.push_back(ev);
   };
 
-  auto player_rect=[&](const Player& p)->Rect{ return Rect{p.x-35.0f,p.y-60.0f,70.0f,120.0f}; };
-  auto mouse_over_player=[&](const Player& p)->bool{
-    float wx,wy; screen_to_world(cam,winW,winH,mouseX,mouseY,wx,wy); Rect r=player_rect(p);
-    return wx>=r.x&&wx<=r.x+r.w&&wy>=r.y&&wy<=r.y+r.h;
+  std::vector<float> drawX, drawY;   // this frame's interpolated agent positions
+  auto mouse_over=[&](float x,float y)->bool{
+    float wx,wy; screen_to_world(cam,winW,winH,mouseX,mouseY,wx,wy);
+    return wx>=x-35.0f&&wx<=x+35.0f&&wy>=y-60.0f&&wy<=y+60.0f;
   };
 
   while(running){
@@ -424,6 +893,7 @@ int main(int,char**){
         auto k=e.key.keysym.sym;
         if(k==SDLK_ESCAPE||k==SDLK_q) running=false;
         if(k==SDLK_F1) showStatsPanel=!showStatsPanel;
+        if(k==SDLK_F2) showProfiler=!showProfiler;
         if(k==SDLK_0){ cam.scale=0.75f; cam.cx=0; cam.cy=0; }
         if(k==SDLK_PLUS||k==SDLK_EQUALS){
           float wx,wy; screen_to_world(cam,winW,winH,mouseX,mouseY,wx,wy);
@@ -435,10 +905,7 @@ int main(int,char**){
         }
         if(k==SDLK_s){
           float wx,wy; screen_to_world(cam,winW,winH,mouseX,mouseY,wx,wy);
-          Crate c; c.x=clampf(wx,20,WORLD_W-20); c.y=clampf(wy,20,WORLD_H-20);
-          int pick=randi(0,3);
-          c.t = pick==0?CrateType::Coins3 : pick==1?CrateType::Food1 : pick==2?CrateType::Speed8s : CrateType::Heal30;
-          crates.push_back(c);
+          queue_input({EV_SPAWN_CRATE,0,clampf(wx,20,WORLD_W-20),clampf(wy,20,WORLD_H-20)});
         }
       }
       if(e.type==SDL_MOUSEWHEEL){
@@ -453,185 +920,177 @@ int main(int,char**){
         if(e.button.button==SDL_BUTTON_LEFT){
           float wx,wy; screen_to_world(cam,winW,winH,e.button.x,e.button.y,wx,wy);
           wx=clampf(wx,10,WORLD_W-10); wy=clampf(wy,10,WORLD_H-10);
-          coins.push_back({wx,wy});
+          queue_input({EV_DROP_COIN,0,wx,wy});
         }
       }
       if(e.type==SDL_MOUSEBUTTONUP){
         if(e.button.button==SDL_BUTTON_RIGHT) rightDragging=false;
       }
     }
+    wantStats.store(showProfiler,std::memory_order_relaxed);
 
-    Uint64 now=SDL_GetPerformanceCounter();
-    double elapsed=(double)(now-prev)/(double)SDL_GetPerformanceFrequency();
-    if(elapsed>0.25) elapsed=0.25;
-    prev=now; acc+=elapsed;
-
-    crateSpawnTimer -= elapsed;
-    if(crateSpawnTimer<=0.0){
-      Crate c; c.x=randf(60.0f, WORLD_W-60.0f); c.y=randf(100.0f, WORLD_H-60.0f);
-      int pick=randi(0,3);
-      c.t = pick==0?CrateType::Coins3 : pick==1?CrateType::Food1 : pick==2?CrateType::Speed8s : CrateType::Heal30;
-      crates.push_back(c);
-      crateSpawnTimer = randf(12.0f, 22.0f);
-    }
-
-    while(acc>=dt){
-      ++tick;
-
-      std::unordered_map<std::string,std::string> hudMap,intentMap;
-      std::unordered_map<std::string,std::pair<float,float>> velMap;
-      brain.tick_and_get_decisions(tick,(float)dt,players,coins,hudMap,velMap,intentMap);
+    uint64_t tDraw=prof_now_ns();
+    snaps.acquire();
+    WorldSnapshot& snap=snaps.front();
+    Agents& players=snap.players;
 
-      for(auto& p:players){
-        auto it=velMap.find(p.name);
-        float vx = (it!=velMap.end())? it->second.first : 0.0f;
-        float vy = (it!=velMap.end())? it->second.second: 0.0f;
-        float boost = (p.speedBoostT>0.0f ? 1.5f : 1.0f);
-        p.vx = vx*boost; p.vy = vy*boost;
-      }
-
-      const float sepRadius=80.0f, sepRadius2=sepRadius*sepRadius;
-      const float sepStrength=320.0f, maxSpeed=220.0f, maxAccel=600.0f;
-      for(size_t i=0;i<players.size();++i){
-        float ax=0, ay=0;
-        for(size_t j=0;j<players.size();++j){
-          if(i==j) continue;
-          float d2=dist2(players[i].x,players[i].y,players[j].x,players[j].y);
-          if(d2<sepRadius2 && d2>1.0f){
-            float d=std::sqrt(d2);
-            float nx=(players[i].x-players[j].x)/d, ny=(players[i].y-players[j].y)/d;
-            float w=(sepRadius - d)/sepRadius;
-            ax += nx*sepStrength*w; ay += ny*sepStrength*w;
-            brain.reward(players[i].name, -0.02*w, "too_close");
-          }
-        }
-        float alen=std::sqrt(ax*ax+ay*ay);
-        if(alen>maxAccel){ ax*=maxAccel/alen; ay*=maxAccel/alen; }
-        players[i].vx += ax*(float)dt; players[i].vy += ay*(float)dt;
-        float vlen=std::sqrt(players[i].vx*players[i].vx+players[i].vy*players[i].vy);
-        if(vlen>maxSpeed){ players[i].vx*=maxSpeed/vlen; players[i].vy*=maxSpeed/vlen; }
-      }
-
-      for(auto& p:players){
-        if(p.speedBoostT>0.0f) p.speedBoostT = std::max(0.0f, p.speedBoostT - (float)dt);
-
-        p.x += p.vx*(float)dt; p.y += p.vy*(float)dt;
-        p.x = clampf(p.x,0,WORLD_W); p.y = clampf(p.y,0,WORLD_H);
-
-        float baseDrain=4.0f;
-        float staminaFactor = 1.0f - 0.12f * (p.intel/100.0f);
-        staminaFactor = clampf(staminaFactor,0.7f,1.0f);
-        float eDrain = baseDrain * staminaFactor;
-
-        p.energy = clampf(p.energy - eDrain*(float)dt, 0, 100);
-        p.health = clampf(p.health - ((p.energy<=0)?6.0f:1.0f)*(float)dt, 0, 100);
-
-        if(p.health<=0){
-          p.deaths += 1;
-          p.x=1024; p.y=1024; p.vx=0; p.vy=0;
-          p.health=100; p.energy=60;
-          p.coins=std::max(0,p.coins-1);
-          p.status.clear();
-          brain.reward(p.name, -2.0, "death");
-        }
-
-        apply_transactions(p);
-        collect_coins(p);
-        collect_crates(p);
-
-        auto h=hudMap.find(p.name); p.hud = (h!=hudMap.end())? h->second : (p.name+" | ...");
-        auto it=intentMap.find(p.name); p.intent = (it!=intentMap.end())? it->second : "";
-      }
-
-      acc-=dt;
+    // Agents are drawn a tick behind the sim, blended from the tick before by
+    // how long ago the snapshot was taken. Respawns (long jumps) aren't blended.
+    const float alpha=(float)std::clamp((double)(tDraw-snap.takenNs)*1e-9/dt,0.0,1.0);
+    drawX.resize(players.size()); drawY.resize(players.size());
+    for(size_t i=0;i<players.size();++i){
+      float x0=snap.prevX[i], y0=snap.prevY[i], x1=players.x[i], y1=players.y[i];
+      if(std::fabs(x1-x0)+std::fabs(y1-y0)>64.0f){ x0=x1; y0=y1; }
+      drawX[i]=x0+(x1-x0)*alpha; drawY[i]=y0+(y1-y0)*alpha;
     }
 
     glClearColor(0.05f,0.06f,0.08f,1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
     float vw=WORLD_W/cam.scale, vh=WORLD_H/cam.scale;
-    begin_ortho(cam.cx,cam.cx+vw,cam.cy+vh,cam.cy);
+    const float viewX0=cam.cx, viewY0=cam.cy, viewX1=cam.cx+vw, viewY1=cam.cy+vh;
+    begin_ortho(viewX0,viewX1,viewY1,viewY0);
 
-    draw_filled_rect(0,0,WORLD_W,WORLD_H, 0.10f,0.11f,0.13f,1.0f);
-    draw_filled_rect(STORE.x,STORE.y,STORE.w,STORE.h, 0.15f,0.35f,0.20f,0.45f);
-    draw_filled_rect(RECHARGE.x,RECHARGE.y,RECHARGE.w,RECHARGE.h, 0.20f,0.25f,0.55f,0.45f);
+    batch.rect(0,0,WORLD_W,WORLD_H, 0.10f,0.11f,0.13f,1.0f);
+    batch.rect(STORE.x,STORE.y,STORE.w,STORE.h, 0.15f,0.35f,0.20f,0.45f);
+    batch.rect(RECHARGE.x,RECHARGE.y,RECHARGE.w,RECHARGE.h, 0.20f,0.25f,0.55f,0.45f);
 
-    if(font){
-      draw_text_outlined(font, "STORE", zoneLabel, outlineCol,
-                         STORE.x + STORE.w*0.5f - 40.0f, STORE.y + 18.0f);
-      draw_text_outlined(font, "RECHARGE", zoneLabel, outlineCol,
-                         RECHARGE.x + 12.0f, RECHARGE.y + 18.0f);
-    }
+    draw_text_outlined(font, batch, "STORE", zoneLabel, outlineCol,
+                       STORE.x + STORE.w*0.5f - 40.0f, STORE.y + 18.0f);
+    draw_text_outlined(font, batch, "RECHARGE", zoneLabel, outlineCol,
+                       RECHARGE.x + 12.0f, RECHARGE.y + 18.0f);
 
+    // Coins and crates: only the cull tiles the view overlaps (padded by the
+    // sprite half-size), so a zoomed-in view of a huge world stays cheap.
+    auto visible=[&](const SpatialGrid& g,float pad,auto&& f){
+      g.query_rect(viewX0-pad,viewY0-pad,viewX1+pad,viewY1+pad,f);
+    };
     if(coinTex){
-      for(const auto& c:coins) draw_textured_quad(*coinTex,c.x-17.5f,c.y-17.5f,35.0f,35.0f);
+      visible(snap.coinTiles,18.0f,[&](int32_t k){ const Coin& c=snap.coins[k]; batch.sprite(*coinTex,c.x-17.5f,c.y-17.5f,35.0f,35.0f); });
     } else {
-      for(const auto& c:coins) draw_filled_rect(c.x-8,c.y-8,16,16,0.9f,0.8f,0.1f,1.0f);
+      visible(snap.coinTiles,18.0f,[&](int32_t k){ const Coin& c=snap.coins[k]; batch.rect(c.x-8,c.y-8,16,16,0.9f,0.8f,0.1f,1.0f); });
     }
 
-    for(const auto& cr:crates){
-      draw_filled_rect(cr.x-18, cr.y-18, 36, 36, 0.68f, 0.35f, 0.85f, 0.95f);
+    visible(snap.crateTiles,18.0f,[&](int32_t k){
+      const Crate& cr=snap.crates[k];
+      batch.rect(cr.x-18, cr.y-18, 36, 36, 0.68f, 0.35f, 0.85f, 0.95f);
+    });
+
+    // Agents in index order (sprites overlap), each tested against the view.
+    for(size_t i=0;i<players.size();++i){
+      float x=drawX[i], y=drawY[i];
+      if(x+35.0f<viewX0 || x-35.0f>viewX1 || y+60.0f<viewY0 || y-60.0f>viewY1) continue;
+      if(playerTex) batch.sprite(*playerTex,x-35.0f,y-60.0f,70.0f,120.0f);
+      else batch.rect(x-15,y-25,30,50,0.8f,0.2f,0.2f,1.0f);
     }
 
-    for(const auto& p:players){
-      if(playerTex) draw_textured_quad(*playerTex,p.x-35.0f,p.y-60.0f,70.0f,120.0f);
-      else draw_filled_rect(p.x-15,p.y-25,30,50,0.8f,0.2f,0.2f,1.0f);
-      if(!p.hud.empty() && font){
-        float wx,wy; screen_to_world(cam,winW,winH,mouseX,mouseY,wx,wy);
-        if(wx>=p.x-35.0f && wx<=p.x+35.0f && wy>=p.y-60.0f && wy<=p.y+60.0f){
-          std::string hud = p.hud;
-          if(!p.status.empty()) hud += " [" + p.status + "]";
-          Texture t=text_to_texture(font,hud,hudColor);
-          if(t.id){
-            draw_textured_quad(t,p.x - t.w*0.5f, p.y-85.0f, (float)t.w,(float)t.h);
-            glDeleteTextures(1,&t.id);
-          }
+    batch.flush();
+    uint64_t tHud=prof_now_ns();
+    frameProf.add(PH_DRAW_WORLD,tHud-tDraw);
+
+    // Hover HUD after all sprites so it stays on top. The sim thread asks the
+    // brain for the hovered agents' lines and sends them with its next
+    // snapshot (world 0's agents lead the brain's order, so their index is the
+    // global one); until they arrive the line is formatted from the snapshot.
+    if(font.ok()){
+      hovered.clear();
+      for(size_t i=0;i<players.size();++i) if(mouse_over(drawX[i],drawY[i])) hovered.push_back((int32_t)i);
+      { std::lock_guard<std::mutex> lk(simM); wantHud.assign(hovered.begin(),hovered.end()); }
+      for(int32_t i:hovered){
+        auto it=std::find(snap.hudAgent.begin(),snap.hudAgent.end(),i);
+        if(it!=snap.hudAgent.end()) hudLine=snap.hudText[(size_t)(it-snap.hudAgent.begin())];
+        else {
+          Player p(players,(size_t)i);
+          format_hud(hudLine,p.name,p.health,p.energy,p.coins,p.food,p.perf,p.intent);
+          if(p.status) hudLine.append(" [").append(p.status).append("]");
         }
+        draw_text(font, batch, hudLine, hudColor, drawX[i] - font.measure(hudLine)*0.5f, drawY[i]-85.0f);
       }
     }
+    batch.flush();
+    uint64_t tPanel=prof_now_ns();
+    frameProf.add(PH_HUD,tPanel-tHud);
 
     begin_ortho(0,(float)winW,(float)winH,0);
-    if(showStatsPanel && fontSmall){
-      float panelW=610.0f, panelH=(float)winH-40.0f, panelX=20.0f, panelY=20.0f;
-      draw_filled_rect(panelX,panelY,panelW,panelH, 0.03f,0.03f,0.03f,0.92f);
-
-      draw_text_outlined(font, "Self-Learning AI EcoSys - Player Stats (F1)", neonTitle, outlineCol, panelX+12, panelY+10);
-      draw_text_outlined(fontSmall, "Rank  Name        H   E   C   F   IQ   P    D   Act / Status",
-                         neonGreen, outlineCol, panelX+12, panelY+44);
-
-      std::vector<const Player*> order; order.reserve(players.size());
-      for(const auto& p:players) order.push_back(&p);
-      std::sort(order.begin(),order.end(),[](const Player* a,const Player* b){ return a->perf>b->perf; });
-
-      float y=panelY+70.0f;
-      for(size_t i=0;i<order.size();++i){
-        const Player* p=order[i];
-        std::ostringstream line; line.setf(std::ios::fixed); line.precision(0);
-        line<<(i+1<10?"  ":" ")<<(i+1)<<".  "
-            <<p->name<<(p->name.size()<8? std::string(8-p->name.size(),' ') : " ")
-            <<" "<<p->health
-            <<"  "<<p->energy
-            <<"  "<<p->coins
-            <<"  "<<p->food
-            <<"  "<<p->intel
-            <<"  "<<p->perf
-            <<"   "<<p->deaths
-            <<"   "<<(p->intent.empty()?"-":p->intent);
-        if(!p->status.empty()) line<<"  ["<<p->status<<"]";
-        draw_text_outlined(fontSmall, line.str(), neonGreen, outlineCol, panelX+12, y);
+    if(showStatsPanel && fontSmall.ok()){
+      const float panelW=610.0f, panelH=(float)winH-40.0f, panelX=20.0f, panelY=20.0f;
+      const size_t fit=1+(size_t)std::max(0.0f,std::floor((panelH-94.0f)/22.0f));
+      const bool changed=panel.refresh(players,fit);
+      auto draw_panel=[&](float x0,float y0){
+        batch.rect(x0,y0,panelW,panelH, 0.03f,0.03f,0.03f,0.92f);
+        draw_text_outlined(font, batch, "Self-Learning AI EcoSys - Player Stats (F1)", neonTitle, outlineCol, x0+12, y0+10);
+        draw_text_outlined(fontSmall, batch, "Rank  Name        H   E   C   F   IQ   P    D   Act / Status",
+                           neonGreen, outlineCol, x0+12, y0+44);
+        float y=y0+70.0f;
+        for(const std::string& row:panel.rows){ draw_text_outlined(fontSmall, batch, row, neonGreen, outlineCol, x0+12, y); y+=22.0f; }
+        batch.flush();
+      };
+      if(panel.target((int)panelW,(int)panelH)){
+        if(changed || !panel.drawn){
+          // Premultiplied alpha in the texture, so the blit below composites like direct drawing.
+          glBindFramebuffer(GL_FRAMEBUFFER,panel.fbo);
+          glViewport(0,0,panel.tex.w,panel.tex.h);
+          glClearColor(0,0,0,0); glClear(GL_COLOR_BUFFER_BIT);
+          glBlendFuncSeparate(GL_SRC_ALPHA,GL_ONE_MINUS_SRC_ALPHA,GL_ONE,GL_ONE_MINUS_SRC_ALPHA);
+          begin_ortho(0,panelW,panelH,0);
+          draw_panel(0,0);
+          glBindFramebuffer(GL_FRAMEBUFFER,0);
+          glViewport(0,0,winW,winH);
+          begin_ortho(0,(float)winW,(float)winH,0);
+          panel.drawn=true;
+        }
+        // Render-target rows start at the bottom, hence the flipped v.
+        glBlendFunc(GL_ONE,GL_ONE_MINUS_SRC_ALPHA);
+        batch.use(panel.tex.id);
+        batch.quad(panelX,panelY,panelW,panelH,0,1,1,0,255,255,255,255);
+        batch.flush();
+        glBlendFunc(GL_SRC_ALPHA,GL_ONE_MINUS_SRC_ALPHA);
+      } else draw_panel(panelX,panelY);
+    }
+    frameProf.add(PH_PANEL,prof_now_ns()-tPanel);
+
+    // F2: rolling per-phase timings, next to the stats panel.
+    if(showProfiler && fontSmall.ok()){
+      float ox=showStatsPanel? 642.0f : 20.0f, oy=20.0f, ow=560.0f, oh=100.0f+22.0f*(PH_COUNT+1);
+      batch.rect(ox,oy,ow,oh, 0.03f,0.03f,0.03f,0.92f);
+      draw_text_outlined(font, batch, "Phase timings, us (F2)", neonTitle, outlineCol, ox+12, oy+10);
+      const float colX[3]={ox+300.0f,ox+390.0f,ox+480.0f};
+      const char* heads[3]={"min","avg","p99"};
+      auto right=[&](const std::string& t,float x,float y){ draw_text_outlined(fontSmall, batch, t, neonGreen, outlineCol, x+60.0f-fontSmall.measure(t), y); };
+      float y=oy+44.0f;
+      draw_text_outlined(fontSmall, batch, "per tick", neonGreen, outlineCol, ox+12, y);
+      for(int c=0;c<3;++c) right(heads[c],colX[c],y);
+      y+=26.0f;
+      for(int p=0;p<PH_COUNT;++p){
+        if(p==PH_SIM_COUNT){ draw_text_outlined(fontSmall, batch, "per frame", neonGreen, outlineCol, ox+12, y); y+=26.0f; }
+        // Tick phases come from the sim thread with the snapshot.
+        Profiler::Stats st= p<PH_SIM_COUNT? (snap.hasStats? snap.simStats[p] : Profiler::Stats()) : frameProf.stats((Phase)p);
+        char buf[3][32];
+        std::snprintf(buf[0],sizeof buf[0],"%.1f",st.minUs);
+        std::snprintf(buf[1],sizeof buf[1],"%.1f",st.avgUs);
+        std::snprintf(buf[2],sizeof buf[2],"%.1f",st.p99Us);
+        draw_text_outlined(fontSmall, batch, PHASE_NAMES[p], neonGreen, outlineCol, ox+24, y);
+        for(int c=0;c<3;++c) right(buf[c],colX[c],y);
         y+=22.0f;
-        if(y>panelY+panelH-24.0f) break;
       }
+      batch.flush();
     }
 
+    uint64_t tSwap=prof_now_ns();
     SDL_GL_SwapWindow(win);
+    frameProf.add(PH_PRESENT,prof_now_ns()-tSwap);
+    frameProf.commit_frame();
   }
 
-  brain.shutdown();
-  if(fontSmall) TTF_CloseFont(fontSmall);
-  if(font) TTF_CloseFont(font);
+  simRun.store(false,std::memory_order_release);
+  simThread.join();
+  const bool saved=finish_run();
+  panel.destroy();
+  batch.destroy();
+  fontSmall.destroy();
+  font.destroy();
   SDL_GL_DeleteContext(glctx);
   SDL_DestroyWindow(win);
   TTF_Quit(); IMG_Quit(); SDL_Quit();
-  return 0;
+  return saved? 0 : 1;
 }
 
@@ -0,0 +1,317 @@
+// C++ port of brain.py's tabular Q-learner (--brain native): same observation,
+// discretisation, epsilon-greedy choice, update rule and policy, with the
+// interpreter out of the tick. Given the same frames and rewards it makes the
+// same decisions as brain.py, draw for draw (--brain parity checks that), so
+// brain.py stays the place to try ideas and this is the fast path for them.
+#pragma once
+
+#include "brain_backend.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <cerrno>
+#include <sys/stat.h>
+
+// CPython's random.Random: MT19937 seeded like random.seed(int) (init_by_array
+// over the 32-bit words of the seed), random() from two draws, and choice()
+// by rejection over getrandbits(bit_length(n)). Each agent owns one, as in
+// brain.py, so both backends consume the same stream.
+struct PyRandom {
+  static constexpr int N=624, M=397;
+  uint32_t mt[N]; int idx=N;
+
+  explicit PyRandom(uint32_t seed=0){ this->seed(seed); }
+  void seed(uint32_t s){
+    init_genrand(19650218u);
+    int i=1;
+    for(int k=N;k;--k){   // init_by_array with the one-word key {s}
+      mt[i]=(mt[i]^((mt[i-1]^(mt[i-1]>>30))*1664525u))+s;
+      if(++i>=N){ mt[0]=mt[N-1]; i=1; }
+    }
+    for(int k=N-1;k;--k){
+      mt[i]=(mt[i]^((mt[i-1]^(mt[i-1]>>30))*1566083941u))-(uint32_t)i;
+      if(++i>=N){ mt[0]=mt[N-1]; i=1; }
+    }
+    mt[0]=0x80000000u;
+    idx=N;
+  }
+  uint32_t next_u32(){
+    if(idx>=N) twist();
+    uint32_t y=mt[idx++];
+    y^=y>>11; y^=(y<<7)&0x9d2c5680u; y^=(y<<15)&0xefc60000u; y^=y>>18;
+    return y;
+  }
+  double random(){
+    uint32_t a=next_u32()>>5, b=next_u32()>>6;
+    return (a*67108864.0+b)*(1.0/9007199254740992.0);
+  }
+  uint32_t getrandbits(int k){ return next_u32()>>(32-k); }   // 1 <= k <= 32
+  uint32_t randbelow(uint32_t n){
+    int k=0; for(uint32_t v=n;v;v>>=1) ++k;
+    uint32_t r=getrandbits(k);
+    while(r>=n) r=getrandbits(k);
+    return r;
+  }
+
+private:
+  void init_genrand(uint32_t s){
+    mt[0]=s;
+    for(int i=1;i<N;++i) mt[i]=1812433253u*(mt[i-1]^(mt[i-1]>>30))+(uint32_t)i;
+  }
+  void twist(){
+    for(int i=0;i<N;++i){
+      uint32_t y=(mt[i]&0x80000000u)|(mt[(i+1)%N]&0x7fffffffu);
+      mt[i]=mt[(i+M)%N]^(y>>1)^((y&1u)?0x9908b0dfu:0u);
+    }
+    idx=0;
+  }
+};
+
+// Every agent's Q-values in one table. A state is brain.py's (px//128,
+// py//128, friends, foes) tuple plus the agent index, packed into two words;
+// slots are open-addressed with linear probing and point at 17-value rows
+// stored back to back. Values are doubles because brain.py's are.
+struct QTable {
+  static constexpr int ACTIONS=17;
+  struct Key { uint64_t a,b; bool operator==(const Key& o) const { return a==o.a && b==o.b; } };
+  struct Slot { Key k; int32_t row=-1; };
+  std::vector<Slot> slots=std::vector<Slot>(1024);
+  std::vector<double> q;      // row r is q[r*ACTIONS .. +ACTIONS)
+  size_t rows=0;
+
+  static Key key(uint32_t agent,int px,int py,int friends,int foes){
+    return {(uint64_t)agent<<32 | (uint64_t)(uint16_t)px<<16 | (uint16_t)py,
+            (uint64_t)(uint32_t)friends<<32 | (uint32_t)foes};
+  }
+  // Row of `k`, added as zeros if new (brain.py's _ensure).
+  int32_t ensure(const Key& k){
+    if(2*(rows+1)>slots.size()) rehash(slots.size()*2);
+    Slot& s=probe(slots,k);
+    if(s.row<0){
+      s.k=k; s.row=(int32_t)rows++;
+      q.resize(rows*ACTIONS,0.0);
+    }
+    return s.row;
+  }
+  // Room for `n` rows without regrowing; learning new states past that still allocates.
+  void reserve(size_t n){
+    size_t cap=slots.size();
+    while(cap<2*n) cap*=2;
+    if(cap>slots.size()) rehash(cap);
+    q.reserve(n*ACTIONS);
+  }
+  double* row(int32_t r){ return q.data()+(size_t)r*ACTIONS; }
+  double max_of(int32_t r) const {
+    const double* v=q.data()+(size_t)r*ACTIONS;
+    double m=v[0];
+    for(int a=1;a<ACTIONS;++a) if(v[a]>m) m=v[a];
+    return m;
+  }
+
+private:
+  static size_t hash(const Key& k){
+    uint64_t h=k.a*0x9e3779b97f4a7c15ull ^ (k.b+0x632be59bd9b4e019ull);
+    h^=h>>31; h*=0xbf58476d1ce4e5b9ull; h^=h>>29;
+    return (size_t)h;
+  }
+  static Slot& probe(std::vector<Slot>& t,const Key& k){
+    const size_t mask=t.size()-1;
+    for(size_t i=hash(k)&mask;;i=(i+1)&mask)
+      if(t[i].row<0 || t[i].k==k) return t[i];
+  }
+  void rehash(size_t cap){
+    std::vector<Slot> bigger(cap);
+    for(const Slot& s:slots) if(s.row>=0) probe(bigger,s.k)=s;
+    slots.swap(bigger);
+  }
+};
+
+// zlib's CRC-32 of the name's bytes (UTF-8, as brain.py encodes it).
+static inline uint32_t name_crc32(const std::string& s){
+  uint32_t c=0xffffffffu;
+  for(unsigned char b:s){
+    c^=b;
+    for(int k=0;k<8;++k) c=(c>>1)^(0xedb88320u&(0u-(c&1u)));
+  }
+  return ~c;
+}
+
+struct NativeBrain : BrainBackend {
+  static constexpr int FOOD_PRICE=5;
+  const double epsilon=0.10, alpha=0.25, gamma=0.96, speed=155.0;
+  struct Agent { PyRandom rng; int32_t lastRow=-1; int lastAction=-1; };
+  std::vector<std::string> names;
+  std::vector<Agent> agents;
+  QTable table;
+  size_t worlds=1;
+  int tick=0;
+  std::string savePath="saves/native_brain.bin";
+
+  bool call_init(const std::vector<std::string>& n,size_t w) override {
+    names=n; worlds=std::max<size_t>(1,w);
+    agents.assign(names.size(),Agent());
+    for(size_t i=0;i<names.size();++i) agents[i].rng.seed(name_crc32(names[i]));   // brain.py: zlib.crc32(name)
+    io.resize(names.size(),worlds);
+    table=QTable();
+    table.reserve(std::min<size_t>(names.size()*256,1u<<16));
+    if(!fresh && persist) load();
+    return true;
+  }
+
+  bool decide(int t,float) override {
+    tick=t;
+    const size_t n=names.size(), per=n/worlds;
+    for(size_t i=0;i<n;++i){
+      const size_t w=i/per;
+      const bool worldHasCoins=io.coinOff[w+1]>io.coinOff[w];
+      Agent& a=agents[i];
+
+      // _obs / _disc, with the crowd counts the engine computed
+      const double px=io.x[i], py=io.y[i];
+      const int fr=io.friends[i], fo=io.foes[i];
+      const int32_t s=table.ensure(QTable::key((uint32_t)i,(int)std::floor(px/128.0),(int)std::floor(py/128.0),fr,fo));
+      const int act=select_action(a,s);
+
+      float ux=0, uy=0; int beh=0;
+      policy(act,i,worldHasCoins,ux,uy,beh);
+
+      const bool inStore=in_zone(STORE,px,py), inRech=in_zone(RECHARGE,px,py);
+      double r=-0.01*(fo+fr);
+      if(inStore && (io.coins[i]>=FOOD_PRICE || io.food[i]>0)) r+=0.05;
+      if(inRech && (double)io.energy[i]<90) r+=0.05;
+      if(a.lastRow>=0) update(a.lastRow,a.lastAction,r,s);
+      a.lastRow=s; a.lastAction=act;
+      io.outVel[2*i]=ux; io.outVel[2*i+1]=uy; io.outIntent[i]=beh;
+    }
+    return true;
+  }
+
+  bool hud_line(size_t i,std::string& out) override {
+    if(i>=names.size()) return false;
+    format_hud(out,names[i],io.health[i],io.energy[i],io.coins[i],io.food[i],io.perf[i],io.outIntent[i]);
+    return true;
+  }
+
+  void reward_batch(const RewardQueue& q) override {
+    for(const RewardEvent& e:q.ev){
+      if(e.agent<0 || (size_t)e.agent>=agents.size()) continue;
+      Agent& a=agents[e.agent];
+      if(a.lastRow<0) continue;
+      update(a.lastRow,a.lastAction,e.value,a.lastRow);
+    }
+  }
+
+  // The table is saved at exit and read back by call_init (unless `fresh`;
+  // neither happens without `persist`):
+  //   "ECOQTAB1" | u32 agents | u32 rows | per agent: u32 len, name bytes |
+  //   per row: u64 key.a, u64 key.b, f64 q[17]   (key.a's top half is the agent)
+  // Rows are matched to agents by name, so a save from another world count loads too.
+  bool shutdown() override { return !persist || save(); }
+  bool load(){
+    std::FILE* f=std::fopen(savePath.c_str(),"rb");
+    if(!f) return false;
+    char magic[8]; uint32_t hdr[2];
+    bool ok=std::fread(magic,8,1,f)==1 && std::memcmp(magic,"ECOQTAB1",8)==0 && std::fread(hdr,sizeof(hdr),1,f)==1;
+    std::unordered_map<std::string,int64_t> ours;
+    for(size_t i=0;i<names.size();++i) ours.emplace(names[i],(int64_t)i);
+    std::vector<int64_t> agentOf;      // saved agent index -> ours, or -1
+    for(uint32_t k=0;ok && k<hdr[0];++k){
+      uint32_t len=0; std::string s;
+      ok=std::fread(&len,4,1,f)==1 && len<4096;
+      if(ok){ s.resize(len); ok=len==0 || std::fread(&s[0],len,1,f)==1; }
+      auto it=ours.find(s);
+      agentOf.push_back(it==ours.end()? -1 : it->second);
+    }
+    size_t n=0;
+    for(uint32_t r=0;ok && r<hdr[1];++r){
+      QTable::Key k; double q[QTable::ACTIONS];
+      ok=std::fread(&k,sizeof(k),1,f)==1 && std::fread(q,sizeof(q),1,f)==1;
+      const uint64_t saved=k.a>>32;
+      if(!ok || saved>=agentOf.size() || agentOf[saved]<0) continue;
+      k.a=(uint64_t)agentOf[saved]<<32 | (k.a&0xffffffffu);
+      std::memcpy(table.row(table.ensure(k)),q,sizeof(q));
+      ++n;
+    }
+    std::fclose(f);
+    if(!ok) std::fprintf(stderr,"native brain: %s is damaged, loaded %zu rows of it\n",savePath.c_str(),n);
+    else if(n) std::printf("native brain: resuming from %zu saved Q-rows\n",n);
+    return ok;
+  }
+  bool save(){
+    // brain.py creates saves/ when it is imported; without it nobody has.
+    const size_t slash=savePath.rfind('/');
+    if(slash!=std::string::npos && slash>0 && mkdir(savePath.substr(0,slash).c_str(),0755)!=0 && errno!=EEXIST){
+      std::perror(savePath.substr(0,slash).c_str());
+      return false;
+    }
+    const std::string tmp=savePath+".tmp";
+    std::FILE* f=std::fopen(tmp.c_str(),"wb");
+    if(!f){ std::perror(tmp.c_str()); return false; }
+    uint32_t hdr[2]={(uint32_t)names.size(),(uint32_t)table.rows};
+    bool ok=std::fwrite("ECOQTAB1",8,1,f)==1 && std::fwrite(hdr,sizeof(hdr),1,f)==1;
+    for(const std::string& s:names){
+      uint32_t len=(uint32_t)s.size();
+      ok=ok && std::fwrite(&len,4,1,f)==1 && (len==0 || std::fwrite(s.data(),len,1,f)==1);
+    }
+    for(const QTable::Slot& s:table.slots){
+      if(s.row<0) continue;
+      ok=ok && std::fwrite(&s.k,sizeof(s.k),1,f)==1
+            && std::fwrite(table.row(s.row),sizeof(double)*QTable::ACTIONS,1,f)==1;
+    }
+    ok=std::fclose(f)==0 && ok;
+    if(ok) ok=std::rename(tmp.c_str(),savePath.c_str())==0;
+    if(!ok) std::fprintf(stderr,"native brain: could not save %s\n",savePath.c_str());
+    return ok;
+  }
+
+private:
+  static bool in_zone(const Rect& z,double x,double y){
+    return z.x<=x && x<=(double)z.x+z.w && z.y<=y && y<=(double)z.y+z.h;
+  }
+  int select_action(Agent& a,int32_t s){
+    if(a.rng.random()<epsilon) return (int)a.rng.randbelow(QTable::ACTIONS);
+    const double* q=table.row(s);
+    const double m=table.max_of(s);
+    int idx[QTable::ACTIONS], k=0;
+    for(int i=0;i<QTable::ACTIONS;++i) if(q[i]==m) idx[k++]=i;
+    return idx[a.rng.randbelow((uint32_t)k)];
+  }
+  void update(int32_t s,int act,double r,int32_t sp){
+    const double target=r+gamma*table.max_of(sp);
+    double& v=table.row(s)[act];
+    v+=alpha*(target-v);
+  }
+  // unit_towards(...)*speed, rounded to float like the memoryview store.
+  void towards(double ax,double ay,double bx,double by,float& ux,float& uy) const {
+    const double dx=bx-ax, dy=by-ay, d=std::pow(dx*dx+dy*dy,0.5);
+    if(d==0){ ux=uy=0; return; }
+    ux=(float)(dx/d*speed); uy=(float)(dy/d*speed);
+  }
+  void policy(int a,size_t i,bool coins,float& ux,float& uy,int& beh){
+    const double px=io.x[i], py=io.y[i], E=io.energy[i], H=io.health[i];
+    const int C=io.coins[i], F=io.food[i];
+    const bool needStore=(C>=FOOD_PRICE && (H<85 || E<70)) || (F>0 && (H<80 || E<80));
+    if(E<15) a=11;
+    else if(needStore) a=10;
+    else if(coins && C<FOOD_PRICE) a=9;
+
+    if(a==9 && coins){
+      towards(px,py,io.nearCoin[2*i],io.nearCoin[2*i+1],ux,uy); beh=1;
+    } else if(a==10){
+      towards(px,py,(double)STORE.x+STORE.w/2.0,(double)STORE.y+STORE.h/2.0,ux,uy); beh=2;
+    } else if(a==11){
+      towards(px,py,(double)RECHARGE.x+RECHARGE.w/2.0,(double)RECHARGE.y+RECHARGE.h/2.0,ux,uy); beh=3;
+    } else if(a>=1 && a<=8){
+      static const int DIRS[9][2]={{0,0},{0,-1},{0,1},{-1,0},{1,0},{-1,-1},{1,-1},{-1,1},{1,1}};
+      ux=(float)(DIRS[a][0]*speed); uy=(float)(DIRS[a][1]*speed); beh=4;
+    } else if(a==14){
+      const double ang=agents[i].rng.random()*6.2831853;
+      ux=(float)(std::cos(ang)*speed); uy=(float)(std::sin(ang)*speed); beh=5;
+    }
+  }
+};
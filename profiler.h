@@ -0,0 +1,94 @@
+// Per-phase frame profiler: scoped timers add wall time to a phase, and each
+// finished tick (sim phases) or frame (render phases) becomes one sample in a
+// rolling window, from which the overlay reads min/avg/p99.
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <algorithm>
+
+enum Phase : int {
+  // per tick
+  PH_BRIDGE, PH_BRAIN, PH_REWARDS, PH_FEATURES, PH_SEPARATION, PH_INTEGRATE, PH_RULES, PH_RECORD,
+  PH_SIM_COUNT,
+  // per rendered frame
+  PH_DRAW_WORLD=PH_SIM_COUNT, PH_HUD, PH_PANEL, PH_PRESENT,
+  PH_COUNT
+};
+static const char* const PHASE_NAMES[PH_COUNT]={
+  "bridge pack","brain (api_tick)","reward batch","features","separation","integrate","transact/pickup","record",
+  "draw world","hover HUD","stats panel","present"
+};
+static const char* const PHASE_KEYS[PH_SIM_COUNT]={  // CSV column stems
+  "bridge","brain","rewards","features","separation","integrate","rules","record"
+};
+
+static inline uint64_t prof_now_ns(){
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct Profiler {
+  static constexpr int WINDOW=512;        // ~8.5 s of ticks at 60 Hz
+  struct Stats { double minUs=0, avgUs=0, p99Us=0; };
+
+  uint64_t cur[PH_COUNT]={};              // time added since the last commit
+  uint32_t ring[PH_COUNT][WINDOW]={};     // ns per sample
+  int head[2]={0,0}, filled[2]={0,0};     // [0] sim ring, [1] frame ring
+  std::FILE* csv=nullptr;
+
+  void add(Phase p,uint64_t ns){ cur[p]+=ns; }
+
+  void commit_tick(long tick){
+    if(csv){
+      std::fprintf(csv,"%ld",tick);
+      for(int p=0;p<PH_SIM_COUNT;++p) std::fprintf(csv,",%llu",(unsigned long long)cur[p]);
+      std::fputc('\n',csv);
+    }
+    commit(0,PH_SIM_COUNT,0);
+  }
+  void commit_frame(){ commit(PH_SIM_COUNT,PH_COUNT,1); }
+
+  Stats stats(Phase p) const {
+    const int d=p<PH_SIM_COUNT?0:1, n=filled[d];
+    Stats s;
+    if(!n) return s;
+    uint32_t v[WINDOW];
+    std::copy(ring[p],ring[p]+n,v);
+    uint64_t sum=0; uint32_t mn=v[0];
+    for(int i=0;i<n;++i){ sum+=v[i]; mn=std::min(mn,v[i]); }
+    int k=std::min(n-1,(n*99)/100);
+    std::nth_element(v,v+k,v+n);
+    s.minUs=mn*1e-3; s.avgUs=(double)sum/n*1e-3; s.p99Us=v[k]*1e-3;
+    return s;
+  }
+
+  // Per-tick samples (ns) of the sim phases, one row per tick.
+  bool open_csv(const char* path){
+    csv=std::fopen(path,"w");
+    if(!csv){ std::perror(path); return false; }
+    std::fprintf(csv,"tick");
+    for(int p=0;p<PH_SIM_COUNT;++p) std::fprintf(csv,",%s_ns",PHASE_KEYS[p]);
+    std::fputc('\n',csv);
+    return true;
+  }
+  void close_csv(){ if(csv) std::fclose(csv); csv=nullptr; }
+  ~Profiler(){ close_csv(); }
+
+private:
+  void commit(int from,int to,int d){
+    for(int p=from;p<to;++p){
+      ring[p][head[d]]=(uint32_t)std::min<uint64_t>(cur[p],UINT32_MAX);
+      cur[p]=0;
+    }
+    head[d]=(head[d]+1)%WINDOW;
+    filled[d]=std::min(filled[d]+1,WINDOW);
+  }
+};
+
+struct PhaseTimer {
+  Profiler& prof; Phase ph; uint64_t t0;
+  PhaseTimer(Profiler& p,Phase ph_):prof(p),ph(ph_),t0(prof_now_ns()){}
+  ~PhaseTimer(){ prof.add(ph,prof_now_ns()-t0); }
+};
@@ -0,0 +1,276 @@
+// Embedded-Python bridge to brain.py: the synchronous PyBrain and the
+// optional async BrainPipeline (which drives any BrainBackend).
+#pragma once
+
+#include <Python.h>
+
+#include "alloc_scope.h"
+#include "brain_backend.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <sstream>
+
+// Holds the GIL for one call into brain.py, from whichever thread makes it.
+// What the interpreter allocates meanwhile is not counted by --alloc-check.
+struct GilLock {
+  UncountedAllocs uncounted;
+  PyGILState_STATE s;
+  GilLock():s(PyGILState_Ensure()){}
+  ~GilLock(){ PyGILState_Release(s); }
+};
+
+// The GIL is only held inside these calls: between ticks brain.py's own
+// threads (the checkpoint writer) run alongside the C++ physics.
+struct PyBrain : BrainBackend {
+  PyObject* mod=nullptr,*api_init=nullptr,*api_bind=nullptr,*api_tick=nullptr,*api_reward_batch=nullptr,*api_save=nullptr,*api_hud=nullptr;
+  const Coin* boundCoins=nullptr; size_t boundCoinCap=(size_t)-1;
+  PyThreadState* mainState=nullptr;
+  int shardIndex=0, shardCount=1; size_t shardLo=0, shardHi=0;   // set by a --brain-shards worker
+  bool batched=false;            // --brain numpy: brain.py's BatchEngine instead of its per-agent loop
+
+  bool init(const char* module="brain"){
+    Py_Initialize();
+    if(!Py_IsInitialized()){ std::fprintf(stderr,"Py init fail\n"); return false; }
+    PyObject* sys_path=PySys_GetObject((char*)"path");
+    PyList_Append(sys_path,PyUnicode_FromString("."));
+    mod=PyImport_ImportModule(module);
+    if(!mod){ PyErr_Print(); return false; }
+    api_init=PyObject_GetAttrString(mod,"api_init");
+    api_bind=PyObject_GetAttrString(mod,"api_bind");
+    api_tick=PyObject_GetAttrString(mod,"api_tick");
+    api_reward_batch=PyObject_GetAttrString(mod,"api_reward_batch");
+    api_save=PyObject_GetAttrString(mod,"api_save");
+    if(!api_init||!api_bind||!api_tick||!api_reward_batch||!api_save){ PyErr_Print(); return false; }
+    api_hud=PyObject_GetAttrString(mod,"api_hud");   // optional: no hover text without it
+    if(!api_hud) PyErr_Clear();
+    mainState=PyEval_SaveThread();
+    return true;
+  }
+  // Saves (api_save waits for the checkpoint writer) and finalizes Python.
+  bool shutdown() override {
+    if(mainState){ PyEval_RestoreThread(mainState); mainState=nullptr; }
+    bool saved=true;
+    if(api_save){
+      PyObject* r=PyObject_CallFunction(api_save,nullptr);
+      if(!r){ PyErr_Print(); saved=false; }
+      Py_XDECREF(r);
+    }
+    Py_XDECREF(api_hud); Py_XDECREF(api_save); Py_XDECREF(api_reward_batch); Py_XDECREF(api_tick); Py_XDECREF(api_bind); Py_XDECREF(api_init);
+    Py_XDECREF(mod);
+    if(Py_IsInitialized()) Py_Finalize();
+    return saved;
+  }
+  bool call_init(const std::vector<std::string>& names,size_t worlds) override {
+    GilLock gil;
+    std::ostringstream ss;
+    ss<<"{\"bounds\":{\"w\":"<<WORLD_W<<",\"h\":"<<WORLD_H<<"},";
+    ss<<"\"store\":{\"x\":0,\"y\":0,\"w\":360,\"h\":360},";
+    ss<<"\"recharge\":{\"x\":"<<(WORLD_W-360)<<",\"y\":0,\"w\":360,\"h\":360},";
+    ss<<"\"worlds\":"<<worlds<<",";
+    ss<<"\"resume\":"<<(fresh?"false":"true")<<",";
+    if(!persist) ss<<"\"persist\":false,";
+    if(batched) ss<<"\"engine\":\"numpy\",";
+    if(shardCount>1)
+      ss<<"\"shard\":{\"index\":"<<shardIndex<<",\"count\":"<<shardCount<<",\"lo\":"<<shardLo<<",\"hi\":"<<shardHi<<"},";
+    ss<<"\"players\":[";
+    for(size_t i=0;i<names.size();++i){
+      if(i) ss<<",";
+      ss<<"\""<<names[i]<<"\"";
+    }
+    ss<<"]}";
+    PyObject* arg=Py_BuildValue("(s)", ss.str().c_str());
+    PyObject* ret=PyObject_CallObject(api_init,arg);
+    Py_DECREF(arg);
+    if(!ret){ PyErr_Print(); return false; }
+    Py_DECREF(ret);
+    io.resize(names.size(),worlds);
+    boundCoins=nullptr; boundCoinCap=(size_t)-1;
+    return true;
+  }
+
+  static PyObject* view(void* p,size_t bytes,bool writable){
+    static float empty[2];
+    if(!p) p=empty;
+    return PyMemoryView_FromMemory((char*)p,(Py_ssize_t)bytes,writable?PyBUF_WRITE:PyBUF_READ);
+  }
+  // (Re)hands brain.py memoryviews over `io` and the coin storage. Only needed
+  // after init and whenever `io.coinXY` reallocates; the views alias our memory.
+  bool bind(){
+    const std::vector<Coin>& coins=io.coinXY;
+    PyObject* d=PyDict_New();
+    auto put=[&](const char* k,PyObject* v){ PyDict_SetItemString(d,k,v); Py_DECREF(v); };
+    const size_t n=io.x.size(), fb=n*sizeof(float), ib=n*sizeof(int32_t);
+    put("x",view(io.x.data(),fb,false));           put("y",view(io.y.data(),fb,false));
+    put("vx",view(io.vx.data(),fb,false));         put("vy",view(io.vy.data(),fb,false));
+    put("health",view(io.health.data(),fb,false)); put("energy",view(io.energy.data(),fb,false));
+    put("intel",view(io.intel.data(),fb,false));   put("perf",view(io.perf.data(),fb,false));
+    put("coins",view(io.coins.data(),ib,false));   put("food",view(io.food.data(),ib,false));
+    put("coin_xy",view((void*)coins.data(),coins.capacity()*sizeof(Coin),false));
+    put("coin_off",view(io.coinOff.data(),io.coinOff.size()*sizeof(int32_t),false));
+    put("near_coin",view(io.nearCoin.data(),2*fb,false));       put("near_coin_dist",view(io.nearCoinDist.data(),fb,false));
+    put("near_crate",view(io.nearCrate.data(),2*fb,false));     put("near_crate_dist",view(io.nearCrateDist.data(),fb,false));
+    put("near_crate_type",view(io.nearCrateType.data(),ib,false));
+    put("friends",view(io.friends.data(),ib,false));           put("foes",view(io.foes.data(),ib,false));
+    put("out_vel",view(io.outVel.data(),2*fb,true));
+    put("out_intent",view(io.outIntent.data(),ib,true));
+    PyObject* r=PyObject_CallFunctionObjArgs(api_bind,d,nullptr);
+    Py_DECREF(d);
+    if(!r){ PyErr_Print(); return false; }
+    Py_DECREF(r);
+    boundCoins=coins.data(); boundCoinCap=coins.capacity();
+    return true;
+  }
+  void clear_out(){
+    std::fill(io.outVel.begin(),io.outVel.end(),0.0f);
+    std::fill(io.outIntent.begin(),io.outIntent.end(),0);
+  }
+  // Runs api_tick over whatever `io` currently holds (io.pack() fills it).
+  bool decide(int tick,float dt) override {
+    GilLock gil;
+    clear_out();
+    if((io.coinXY.data()!=boundCoins || io.coinXY.capacity()!=boundCoinCap) && !bind()) return false;
+    PyObject* r=PyObject_CallFunction(api_tick,"ifn",tick,(double)dt,(Py_ssize_t)io.coinXY.size());
+    if(!r){ PyErr_Print(); return false; }
+    Py_DECREF(r);
+    return true;
+  }
+  bool hud_line(size_t agent,std::string& out) override {
+    if(!api_hud) return false;
+    GilLock gil;
+    PyObject* r=PyObject_CallFunction(api_hud,"n",(Py_ssize_t)agent);
+    if(!r){ PyErr_Print(); return false; }
+    Py_ssize_t len=0;
+    const char* s=PyUnicode_AsUTF8AndSize(r,&len);
+    if(s) out.assign(s,(size_t)len); else PyErr_Clear();
+    Py_DECREF(r);
+    return s && len>0;
+  }
+  // Delivers the queued events in order; one Python call regardless of count.
+  void reward_batch(const RewardQueue& q) override {
+    if(q.ev.empty()) return;
+    GilLock gil;
+    PyObject* mv=view((void*)q.ev.data(),q.ev.size()*sizeof(RewardEvent),false);
+    PyObject* r=PyObject_CallFunction(api_reward_batch,"On",mv,(Py_ssize_t)q.ev.size());
+    Py_DECREF(mv);
+    if(!r) PyErr_Print();
+    Py_XDECREF(r);
+  }
+};
+
+// Optional pipelined mode (--async-brain K): the brain runs on its own thread.
+// Each decision tick the sim hands over a snapshot and applies the newest
+// finished decisions instead of waiting for this one's, blocking only when
+// those are more than K decisions old (`stride` ticks apart, see --decide-every). A snapshot the brain never got to is dropped, but its
+// rewards ride along with the next one so none are lost. HUD text comes back
+// with the decisions too, for the agents the UI last asked about.
+struct BrainPipeline {
+  struct Snapshot { int tick=0; float dt=0; bool full=false; BridgeBuffers in; RewardQueue rewards; };
+  struct Decisions {
+    int tick=0; bool ok=false; std::vector<float> vel; std::vector<int32_t> intent;
+    std::vector<int32_t> hudAgent; std::vector<std::string> hudText;
+  };
+
+  BrainBackend& brain;
+  const int maxLag, stride;
+  std::mutex m;
+  std::condition_variable cvIn, cvOut;
+  Snapshot pending, work;      // pending: written by the sim; work: owned by the brain thread
+  Decisions done, applied;     // done: latest brain output; applied: the sim's copy
+  std::vector<int32_t> hudWant;                                // agents the UI shows, under m
+  std::vector<int32_t> workHudAgent; std::vector<std::string> workHudText;   // brain thread's
+  std::thread worker;
+  bool stopping=false;
+  long submitted=0, dropped=0, stale=0, waits=0; int worstLag=0;
+
+  BrainPipeline(BrainBackend& b,int k,size_t n,size_t worlds,int stride_=1):brain(b),maxLag(std::max(1,k)),stride(std::max(1,stride_)){
+    pending.in.resize(n,worlds); work.in.resize(n,worlds);
+    pending.rewards.ev.reserve(1024); work.rewards.ev.reserve(1024);   // swapped each decision
+    for(Decisions* d:{&done,&applied}){ d->vel.assign(2*n,0.0f); d->intent.assign(n,0); }
+    applied.tick=-1;
+  }
+  ~BrainPipeline(){ if(worker.joinable()) stop(); }
+  void start(){
+    worker=std::thread([this]{ run(); });
+  }
+  // Joins the worker; undelivered rewards go out here.
+  void stop(){
+    { std::lock_guard<std::mutex> lk(m); stopping=true; }
+    cvIn.notify_all(); cvOut.notify_all();
+    if(worker.joinable()) worker.join();
+    brain.reward_batch(pending.rewards);
+    pending.rewards.clear();
+  }
+  // Takes (and clears) the rewards gathered since the last snapshot along with it.
+  void submit(int tick,float dt,std::vector<World>& worlds,RewardQueue& rewards){
+    {
+      std::lock_guard<std::mutex> lk(m);
+      if(pending.full) ++dropped;
+      pending.tick=tick; pending.dt=dt; pending.full=true;
+      pending.in.pack(worlds);
+      pending.rewards.append(rewards,0);
+      rewards.clear();
+      ++submitted;
+    }
+    cvIn.notify_one();
+  }
+  // Newest finished decisions, waiting only while they lag `tick` by more than maxLag.
+  const Decisions& acquire(int tick){
+    std::unique_lock<std::mutex> lk(m);
+    const int bound=maxLag*stride;
+    if(tick-done.tick>bound){
+      ++waits;
+      cvOut.wait(lk,[&]{ return stopping || tick-done.tick<=bound; });
+    }
+    int lag=(tick-done.tick+stride-1)/stride;
+    if(lag>1) ++stale;
+    worstLag=std::max(worstLag,lag);
+    if(applied.tick!=done.tick){
+      applied.tick=done.tick; applied.ok=done.ok;
+      applied.vel=done.vel; applied.intent=done.intent;
+      applied.hudAgent=done.hudAgent; applied.hudText=done.hudText;
+    }
+    return applied;
+  }
+  // Agents whose HUD text the brain thread should produce with its next decisions.
+  void want_hud(const std::vector<int32_t>& agents){
+    std::lock_guard<std::mutex> lk(m);
+    hudWant=agents;
+  }
+  // HUD text that came back with the applied decisions, if `agent` was asked for.
+  bool hud_line(size_t agent,std::string& out) const {
+    for(size_t k=0;k<applied.hudAgent.size();++k)
+      if((size_t)applied.hudAgent[k]==agent && !applied.hudText[k].empty()){ out=applied.hudText[k]; return true; }
+    return false;
+  }
+  void run(){
+    for(;;){
+      {
+        std::unique_lock<std::mutex> lk(m);
+        cvIn.wait(lk,[&]{ return stopping || pending.full; });
+        if(stopping) return;
+        std::swap(pending,work);
+        pending.full=false; pending.rewards.clear();
+      }
+      brain.reward_batch(work.rewards);
+      brain.io.copy_inputs(work.in);
+      bool ok=brain.decide(work.tick,work.dt);
+      { std::lock_guard<std::mutex> lk(m); workHudAgent=hudWant; }
+      workHudText.resize(workHudAgent.size());
+      for(size_t k=0;k<workHudAgent.size();++k)
+        if(!brain.hud_line((size_t)workHudAgent[k],workHudText[k])) workHudText[k].clear();
+      {
+        std::lock_guard<std::mutex> lk(m);
+        done.tick=work.tick; done.ok=ok;
+        done.vel=brain.io.outVel; done.intent=brain.io.outIntent;
+        done.hudAgent=workHudAgent; done.hudText=workHudText;
+      }
+      cvOut.notify_all();
+    }
+  }
+  void report() const {
+    std::printf("async brain: %ld snapshots, %ld dropped, %ld stale (>1 decision old), %ld waits, max lag %d (bound %d)\n",
+                submitted, dropped, stale, waits, worstLag, maxLag);
+  }
+};
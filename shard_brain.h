@@ -0,0 +1,347 @@
+// Sharded brain.py (--brain-shards N): N worker processes, each an ordinary
+// PyBrain that decides for one contiguous slice of the agents, so policy and
+// Q-updates run on N interpreters and N cores instead of behind one GIL.
+//
+// The sim and the workers share one memory block: a ShardHeader, then the
+// frame (BridgeBuffers::each_input order), outVel, outIntent, the agent names
+// and room for coins and reward events. Each command is written into the
+// header and announced on every worker's eventfd; workers answer on a shared
+// one. Every worker sees the whole frame (brain.py's fallback scans need its
+// neighbours) and writes back only its own slice of velocities and intents.
+// Agents' decisions don't depend on each other, so a sharded run makes the
+// same decisions as a single brain.py.
+#pragma once
+
+#include "pybrain.h"
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+enum ShardCmd : int32_t { SHARD_INIT, SHARD_DECIDE, SHARD_HUD, SHARD_REMAP, SHARD_QUIT };
+
+struct ShardHeader {
+  static constexpr int MAX_SHARDS=64;
+  char magic[8];                 // "ECOSHRD1"
+  uint32_t n, worlds, shards, fresh, persist, batched;
+  int32_t worldW, worldH;        // the sim's set_world_size(), for brain.py's bounds
+  uint64_t coinCap, rewardCap, namesLen, bytes;
+  // Section offsets, set by the sim (ShardBlock::layout).
+  uint64_t inOff[24], velOff, intentOff, namesOff, coinsOff, rewardsOff;
+  // The current command, written by the sim before it signals.
+  int32_t cmd, tick; float dt;
+  uint32_t nCoins, nRewards; int32_t hudAgent;
+  char next[64];                 // SHARD_REMAP: name of the larger block to move to
+  uint32_t lo[MAX_SHARDS], hi[MAX_SHARDS];
+  int32_t ok[MAX_SHARDS];        // each worker's answer to the command
+  char hud[256];
+};
+
+// One mapping of the shared block.
+struct ShardBlock {
+  ShardHeader* h=nullptr;
+  uint8_t* base=nullptr; size_t bytes=0;
+
+  static size_t align(size_t v){ return (v+63)&~(size_t)63; }
+  // Fills o's section offsets for a frame shaped like `io`; returns the block size.
+  static size_t layout(ShardHeader& o,BridgeBuffers& io,size_t coinCap,size_t rewardCap,size_t namesLen){
+    size_t at=align(sizeof(ShardHeader)), k=0;
+    io.each_input([&](void*,size_t b){ o.inOff[k++]=at; at=align(at+b); });
+    o.velOff=at;     at=align(at+io.outVel.size()*sizeof(float));
+    o.intentOff=at;  at=align(at+io.outIntent.size()*sizeof(int32_t));
+    o.namesOff=at;   at=align(at+namesLen);
+    o.coinsOff=at;   at=align(at+coinCap*sizeof(Coin));
+    o.rewardsOff=at; at=align(at+rewardCap*sizeof(RewardEvent));
+    o.coinCap=coinCap; o.rewardCap=rewardCap; o.namesLen=namesLen; o.bytes=at;
+    return at;
+  }
+  bool map(const char* name,bool create,size_t size){
+    int fd=shm_open(name,create? O_CREAT|O_EXCL|O_RDWR : O_RDWR,0600);
+    if(fd<0){ std::fprintf(stderr,"shm_open %s: %s\n",name,std::strerror(errno)); return false; }
+    struct stat st;
+    bool ok= create? ftruncate(fd,(off_t)size)==0 : (fstat(fd,&st)==0 && (size=(size_t)st.st_size)>=sizeof(ShardHeader));
+    void* p= ok? mmap(nullptr,size,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0) : MAP_FAILED;
+    close(fd);
+    if(p==MAP_FAILED){ std::fprintf(stderr,"mapping %s: %s\n",name,std::strerror(errno)); if(create) shm_unlink(name); return false; }
+    base=(uint8_t*)p; bytes=size; h=(ShardHeader*)p;
+    return true;
+  }
+  void unmap(){ if(base) munmap(base,bytes); base=nullptr; h=nullptr; bytes=0; }
+  template<class T> T* at(size_t off) const { return (T*)(base+off); }
+};
+
+static bool shard_signal(int fd){ uint64_t one=1; return write(fd,&one,sizeof one)==(ssize_t)sizeof one; }
+
+// The sim's side: a BrainBackend that forwards every call to the workers.
+struct ShardedBrain : BrainBackend {
+  const int shards;
+  std::string exe="/proc/self/exe";
+  std::string shmName;
+  ShardBlock blk;
+  std::vector<int> goFd; int doneFd=-1;
+  std::vector<pid_t> pids;
+  RewardQueue pending;           // goes out with the next decision
+  bool broken=false;
+  int remaps=0;
+
+  bool batched=false;            // --brain numpy in every worker
+
+  explicit ShardedBrain(int n):shards(std::max(1,std::min(n,ShardHeader::MAX_SHARDS))){}
+  ~ShardedBrain() override { stop_workers(false); }
+
+  bool call_init(const std::vector<std::string>& names,size_t worlds) override {
+    io.resize(names.size(),worlds);
+    std::string blob;
+    for(const std::string& s:names){ blob+=s; blob+='\n'; }
+    shmName="/ecosys-brain."+std::to_string(getpid());
+    if(!create_block(shmName,1024,4096,blob.size())) return fail();
+    pending.ev.reserve(blk.h->rewardCap);   // filled on the tick path
+    ShardHeader& h=*blk.h;
+    std::memcpy(h.magic,"ECOSHRD1",8);
+    h.n=(uint32_t)names.size(); h.worlds=(uint32_t)worlds; h.shards=(uint32_t)shards; h.fresh=fresh; h.persist=persist; h.batched=batched;
+    h.worldW=WORLD_W; h.worldH=WORLD_H;
+    std::memcpy(blk.at<char>(h.namesOff),blob.data(),blob.size());
+    for(int k=0;k<shards;++k){ h.lo[k]=(uint32_t)(names.size()*k/shards); h.hi[k]=(uint32_t)(names.size()*(k+1)/shards); }
+
+    doneFd=eventfd(0,EFD_CLOEXEC);
+    if(doneFd<0) return fail();
+    for(int k=0;k<shards;++k){
+      int fd=eventfd(0,EFD_CLOEXEC);
+      if(fd<0) return fail();
+      goFd.push_back(fd);
+    }
+    for(int k=0;k<shards;++k){
+      // The worker is this binary again, started with its own go fd and the shared done fd.
+      const std::string a[]={exe,"--brain-worker",shmName,std::to_string(k),std::to_string(goFd[k]),std::to_string(doneFd)};
+      char* argv[]={(char*)a[0].c_str(),(char*)a[1].c_str(),(char*)a[2].c_str(),(char*)a[3].c_str(),(char*)a[4].c_str(),(char*)a[5].c_str(),nullptr};
+      pid_t pid=fork();
+      if(pid<0) return fail();
+      if(pid==0){
+        prctl(PR_SET_PDEATHSIG,SIGTERM);
+        fcntl(goFd[k],F_SETFD,0); fcntl(doneFd,F_SETFD,0);
+        execv(argv[0],argv);
+        _exit(127);
+      }
+      pids.push_back(pid);
+    }
+    if(!command(SHARD_INIT)) return fail();
+    for(int k=0;k<shards;++k) if(!h.ok[k]) return fail();
+    // Every worker has it mapped now; nothing else needs the name.
+    shm_unlink(shmName.c_str());
+    std::printf("brain: %d brain.py worker processes, %u to %u agents each\n",shards,h.hi[0]-h.lo[0],h.hi[shards-1]-h.lo[shards-1]);
+    return true;
+  }
+
+  bool decide(int tick,float dt) override {
+    if(broken) return false;
+    if((io.coinXY.size()>blk.h->coinCap || pending.ev.size()>blk.h->rewardCap) && !grow()) return fail();
+    ShardHeader& h=*blk.h;
+    size_t k=0;
+    io.each_input([&](void* p,size_t b){ std::memcpy(blk.base+h.inOff[k++],p,b); });
+    if(!io.coinXY.empty()) std::memcpy(blk.at<Coin>(blk.h->coinsOff),io.coinXY.data(),io.coinXY.size()*sizeof(Coin));
+    if(!pending.ev.empty()) std::memcpy(blk.at<RewardEvent>(blk.h->rewardsOff),pending.ev.data(),pending.ev.size()*sizeof(RewardEvent));
+    h.tick=tick; h.dt=dt; h.nCoins=(uint32_t)io.coinXY.size(); h.nRewards=(uint32_t)pending.ev.size();
+    pending.clear();
+    if(!command(SHARD_DECIDE)) return fail();
+    std::memcpy(io.outVel.data(),blk.at<float>(blk.h->velOff),io.outVel.size()*sizeof(float));
+    std::memcpy(io.outIntent.data(),blk.at<int32_t>(blk.h->intentOff),io.outIntent.size()*sizeof(int32_t));
+    for(int s=0;s<shards;++s) if(!h.ok[s]) return false;
+    return true;
+  }
+
+  bool hud_line(size_t agent,std::string& out) override {
+    if(broken || !blk.h || agent>=blk.h->n) return false;
+    ShardHeader& h=*blk.h;
+    int s=0;
+    while(s+1<shards && agent>=h.hi[s]) ++s;
+    h.hudAgent=(int32_t)agent;
+    if(!command(SHARD_HUD,s)) return fail();
+    if(!h.ok[s] || !h.hud[0]) return false;
+    out.assign(h.hud);
+    return true;
+  }
+
+  void reward_batch(const RewardQueue& q) override { pending.append(q,0); }
+
+  // Last rewards out, then every worker saves (api_save) and exits. False
+  // unless every shard saved and exited cleanly.
+  bool shutdown() override {
+    bool saved=!broken;
+    if(!broken && blk.h && !pids.empty()){
+      if(pending.ev.size()>blk.h->rewardCap && !grow()) saved=false;   // no room for the last rewards
+      else {
+        ShardHeader& h=*blk.h;
+        if(!pending.ev.empty()) std::memcpy(blk.at<RewardEvent>(h.rewardsOff),pending.ev.data(),pending.ev.size()*sizeof(RewardEvent));
+        h.nRewards=(uint32_t)pending.ev.size();
+        saved=command(SHARD_QUIT);
+        for(int s=0;saved && s<shards;++s) saved=h.ok[s]!=0;
+      }
+      pending.clear();
+      saved=stop_workers(saved) && saved;
+    }
+    stop_workers(false);
+    return saved;
+  }
+
+private:
+  // Maps a new block; its header is zero apart from the layout.
+  bool create_block(const std::string& name,size_t coinCap,size_t rewardCap,size_t namesLen){
+    ShardHeader lay{};
+    const size_t size=ShardBlock::layout(lay,io,coinCap,rewardCap,namesLen);
+    shm_unlink(name.c_str());   // a stale one from a crashed run with the same pid
+    ShardBlock b;
+    if(!b.map(name.c_str(),true,size)) return false;
+    std::memcpy(b.h,&lay,sizeof lay);
+    blk=b;
+    return true;
+  }
+  // Moves everyone to a block with twice the room for coins and rewards.
+  bool grow(){
+    ShardBlock old=blk;
+    size_t coinCap=old.h->coinCap, rewardCap=old.h->rewardCap;
+    while(coinCap<io.coinXY.size()) coinCap*=2;
+    while(rewardCap<pending.ev.size()) rewardCap*=2;
+    const std::string name=shmName+"."+std::to_string(++remaps);
+    if(!create_block(name,coinCap,rewardCap,old.h->namesLen)){ blk=old; return false; }
+    ShardHeader& nh=*blk.h;
+    ShardHeader lay=nh;
+    std::memcpy(&nh,old.h,sizeof(ShardHeader));   // same agents and slices ...
+    std::memcpy(nh.inOff,lay.inOff,sizeof lay.inOff);   // ... in the new layout
+    nh.velOff=lay.velOff; nh.intentOff=lay.intentOff; nh.namesOff=lay.namesOff; nh.coinsOff=lay.coinsOff; nh.rewardsOff=lay.rewardsOff;
+    nh.coinCap=lay.coinCap; nh.rewardCap=lay.rewardCap; nh.bytes=lay.bytes;
+    std::memcpy(blk.at<char>(nh.namesOff),old.at<char>(old.h->namesOff),old.h->namesLen);
+    // The command goes out in the old header; the answers come back in the new one.
+    std::snprintf(old.h->next,sizeof old.h->next,"%s",name.c_str());
+    bool ok=post(*old.h,nh,SHARD_REMAP,-1);
+    for(int s=0;ok && s<shards;++s) ok=nh.ok[s]!=0;
+    old.unmap();
+    shm_unlink(name.c_str());
+    return ok;
+  }
+  bool command(ShardCmd c,int only=-1){ return post(*blk.h,*blk.h,c,only); }
+  // Posts `c` in `in` to one worker (or all) and waits for their answers in `out`.
+  bool post(ShardHeader& in,ShardHeader& out,ShardCmd c,int only){
+    in.cmd=c;
+    int want=0;
+    for(int s=0;s<shards;++s){
+      if(only>=0 && s!=only) continue;
+      out.ok[s]=0;
+      if(!shard_signal(goFd[s])) return false;
+      ++want;
+    }
+    while(want>0){
+      pollfd pf{doneFd,POLLIN,0};
+      int r=poll(&pf,1,1000);
+      if(r<0 && errno==EINTR) continue;
+      if(r==0){
+        for(size_t s=0;s<pids.size();++s)
+          if(pids[s]>0 && waitpid(pids[s],nullptr,WNOHANG)==pids[s]){
+            std::fprintf(stderr,"brain shard %zu exited\n",s); pids[s]=-1; return false;
+          }
+        continue;
+      }
+      uint64_t got=0;
+      if(read(doneFd,&got,sizeof got)==(ssize_t)sizeof got) want-=(int)got;
+    }
+    return true;
+  }
+  bool fail(){ broken=true; stop_workers(false); return false; }
+  // True if every worker still running exited with status 0.
+  bool stop_workers(bool graceful){
+    bool clean=true;
+    for(pid_t& p:pids){
+      if(p<=0) continue;
+      if(!graceful) kill(p,SIGTERM);
+      int st=0;
+      clean=waitpid(p,&st,0)==p && WIFEXITED(st) && WEXITSTATUS(st)==0 && clean;
+      p=-1;
+    }
+    pids.clear();
+    for(int fd:goFd) close(fd);
+    goFd.clear();
+    if(doneFd>=0) close(doneFd);
+    doneFd=-1;
+    if(blk.base){ blk.unmap(); shm_unlink(shmName.c_str()); }
+    return clean;
+  }
+};
+
+// Worker process entry (`<binary> --brain-worker NAME SHARD GOFD DONEFD`, as
+// spawned by ShardedBrain): runs brain.py for its slice until SHARD_QUIT.
+static int run_shard_worker(int argc,char** argv){
+  if(argc<6){ std::fprintf(stderr,"--brain-worker NAME SHARD GOFD DONEFD\n"); return 2; }
+  const int shard=std::atoi(argv[3]), goFd=std::atoi(argv[4]), doneFd=std::atoi(argv[5]);
+  std::signal(SIGINT,SIG_IGN);   // Ctrl+C is the sim's; it shuts the workers down in order
+  ShardBlock blk;
+  if(!blk.map(argv[2],false,0) || std::memcmp(blk.h->magic,"ECOSHRD1",8)!=0) return 1;
+  PyBrain brain;
+  const bool up=brain.init();
+  RewardQueue mine;
+  mine.ev.reserve(blk.h->rewardCap);   // refilled every decision
+  std::string hud;
+  // This slice's share of the reward events in the block.
+  auto deliver=[&](const ShardHeader& h,size_t lo,size_t hi){
+    const RewardEvent* r=blk.at<RewardEvent>(h.rewardsOff);
+    mine.clear();
+    for(uint32_t i=0;i<h.nRewards;++i) if((size_t)r[i].agent>=lo && (size_t)r[i].agent<hi) mine.ev.push_back(r[i]);
+    brain.reward_batch(mine);
+  };
+  for(;;){
+    uint64_t go=0;
+    if(read(goFd,&go,sizeof go)!=(ssize_t)sizeof go){ if(errno==EINTR) continue; return 1; }
+    ShardHeader& h=*blk.h;
+    const size_t lo=h.lo[shard], hi=h.hi[shard];
+    bool ok=up;
+    switch(h.cmd){
+      case SHARD_INIT: if(ok){
+        std::vector<std::string> names;
+        const char* s=blk.at<char>(h.namesOff); const char* e=s+h.namesLen;
+        for(const char* p=s;p<e;){ const char* nl=(const char*)std::memchr(p,'\n',(size_t)(e-p)); if(!nl) nl=e; names.emplace_back(p,nl); p=nl+1; }
+        set_world_size(h.worldW,h.worldH);
+        brain.fresh=h.fresh!=0; brain.persist=h.persist!=0; brain.batched=h.batched!=0;
+        brain.shardIndex=shard; brain.shardCount=(int)h.shards; brain.shardLo=lo; brain.shardHi=hi;
+        ok=names.size()==h.n && brain.call_init(names,h.worlds);
+        ShardHeader shape{};   // both sides must agree on the frame's layout
+        ok=ok && ShardBlock::layout(shape,brain.io,h.coinCap,h.rewardCap,h.namesLen)==h.bytes;
+      } break;
+      case SHARD_DECIDE: if(ok){
+        size_t k=0;
+        brain.io.each_input([&](void* p,size_t b){ std::memcpy(p,blk.base+h.inOff[k++],b); });
+        const Coin* c=blk.at<Coin>(h.coinsOff);
+        brain.io.coinXY.assign(c,c+h.nCoins);
+        deliver(h,lo,hi);
+        ok=brain.decide(h.tick,h.dt);
+        std::memcpy(blk.at<float>(h.velOff)+2*lo,brain.io.outVel.data()+2*lo,2*(hi-lo)*sizeof(float));
+        std::memcpy(blk.at<int32_t>(h.intentOff)+lo,brain.io.outIntent.data()+lo,(hi-lo)*sizeof(int32_t));
+      } break;
+      case SHARD_HUD:
+        ok=ok && brain.hud_line((size_t)h.hudAgent,hud);
+        std::snprintf(h.hud,sizeof h.hud,"%s",ok? hud.c_str() : "");
+        break;
+      case SHARD_REMAP: {
+        ShardBlock next;
+        ok=next.map(h.next,false,0);
+        if(ok){ blk.unmap(); blk=next; }
+      } break;
+      case SHARD_QUIT:
+        if(ok){ deliver(h,lo,hi); ok=brain.shutdown(); }
+        blk.h->ok[shard]=ok;
+        shard_signal(doneFd);
+        return ok? 0 : 1;
+    }
+    blk.h->ok[shard]=ok;
+    shard_signal(doneFd);
+  }
+}
@@ -0,0 +1,668 @@
+// Simulation core: agent/coin/crate storage, game rules and the World step.
+// No SDL, GL or Python in here, so tools and benchmarks can build against it.
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <random>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "profiler.h"
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+struct Rect { float x,y,w,h; };
+
+// Agent storage, one array per field, indexed by the agent's dense id. The
+// simulation kernels stream the hot float arrays; names and display strings
+// sit in their own arrays so physics passes never pull them through the cache.
+// Intent is an INTENT_NAMES index and status a static string, so the tick
+// never builds strings for them; HUD text is asked of the brain only when shown.
+struct Agents {
+  std::vector<float> x,y,vx,vy,health,energy,intel,speedBoostT;
+  std::vector<float> perf;
+  std::vector<int32_t> coins,food,deaths;
+  std::vector<int32_t> intent;        // -1 = none this tick
+  std::vector<const char*> status;    // last crate message, or nullptr
+  std::vector<std::string> name;
+
+  size_t size() const { return x.size(); }
+  void reserve(size_t n){
+    for(auto* v:{&x,&y,&vx,&vy,&health,&energy,&intel,&speedBoostT,&perf}) v->reserve(n);
+    for(auto* v:{&coins,&food,&deaths,&intent}) v->reserve(n);
+    status.reserve(n);
+    name.reserve(n);
+  }
+  void add(const std::string& n,float px,float py){
+    x.push_back(px); y.push_back(py); vx.push_back(0); vy.push_back(0);
+    health.push_back(100); energy.push_back(100); intel.push_back(0); speedBoostT.push_back(0);
+    perf.push_back(0); coins.push_back(0); food.push_back(0); deaths.push_back(0);
+    intent.push_back(-1); status.push_back(nullptr);
+    name.push_back(n);
+  }
+};
+
+// Per-agent view over Agents, for game rules and UI code that reads better
+// as p.field. Cheap to make; do not keep one across Agents::add().
+struct Player {
+  const std::string& name;
+  float &x,&y,&vx,&vy,&health,&energy,&intel,&speedBoostT,&perf;
+  int32_t &coins,&food,&deaths,&intent;
+  const char*& status;
+  Player(Agents& a,size_t i)
+    : name(a.name[i]), x(a.x[i]), y(a.y[i]), vx(a.vx[i]), vy(a.vy[i]),
+      health(a.health[i]), energy(a.energy[i]), intel(a.intel[i]), speedBoostT(a.speedBoostT[i]), perf(a.perf[i]),
+      coins(a.coins[i]), food(a.food[i]), deaths(a.deaths[i]), intent(a.intent[i]),
+      status(a.status[i]) {}
+};
+
+struct Coin { float x=0,y=0; };
+
+// Behaviour labels reported by brain.py; the bridge passes the index.
+static const char* const INTENT_NAMES[]={"idle","seek_coin","go_store","recharge","drift","wander"};
+static const int INTENT_COUNT=(int)(sizeof(INTENT_NAMES)/sizeof(INTENT_NAMES[0]));
+
+// Reward reasons, interned. brain.py's REASONS list must use the same order.
+enum RewardReason : int32_t {
+  R_BUY_FOOD_RESERVE, R_EAT_FOOD_DELAYED, R_RECHARGE, R_MAINTAIN_FOOD_RESERVE,
+  R_COLLECT_COIN, R_CRATE_COINS3, R_CRATE_FOOD1, R_CRATE_SPEED, R_CRATE_HEAL30,
+  R_TOO_CLOSE, R_DEATH, R_COUNT
+};
+static const char* const REWARD_NAMES[R_COUNT]={
+  "buy_food_reserve","eat_food_delayed","recharge","maintain_food_reserve",
+  "collect_coin","crate_coins3","crate_food1","crate_speed","crate_heal30",
+  "too_close","death"
+};
+
+// One tick's reward events, handed to brain.py in a single call.
+struct RewardEvent { int32_t agent; int32_t reason; double value; };
+static_assert(sizeof(RewardEvent)==16,"brain.py unpacks rewards as '=iid'");
+struct RewardQueue {
+  std::vector<RewardEvent> ev;
+  void push(size_t agent,double value,RewardReason reason){ ev.push_back({(int32_t)agent,reason,value}); }
+  void clear(){ ev.clear(); }
+  // Appends another queue's events with their agent indices shifted by `offset`.
+  void append(const RewardQueue& o,int32_t offset){
+    for(const RewardEvent& e:o.ev) ev.push_back({e.agent+offset,e.reason,e.value});
+  }
+};
+
+enum class CrateType { Coins3, Food1, Speed8s, Heal30 };
+struct Crate { float x=0,y=0; CrateType t=CrateType::Coins3; };
+
+// World size in px, the same for every world of a run. main.cpp's --world WxH
+// sets it through set_world_size() before any World is built; it never
+// changes after that, so every thread can read it freely.
+static int WORLD_W=2048, WORLD_H=2048;
+static const Rect STORE    ={0,0,360,360};
+static Rect RECHARGE       ={WORLD_W-360.0f,0,360,360};
+static const int WORLD_MIN=1024, WORLD_MAX=65536;
+static inline void set_world_size(int w,int h){
+  WORLD_W=w; WORLD_H=h;
+  RECHARGE={w-360.0f,0,360,360};
+}
+
+static float clampf(float v,float lo,float hi){ return v<lo?lo:(v>hi?hi:v); }
+static bool in_rect(const Rect& r,float x,float y){ return x>=r.x&&x<=r.x+r.w&&y>=r.y&&y<=r.y+r.h; }
+static float dist2(float ax,float ay,float bx,float by){ float dx=ax-bx,dy=ay-by; return dx*dx+dy*dy; }
+
+// Per-agent integration: speed-boost countdown, position step + world clamp,
+// IQ-scaled energy drain and health drain. The SIMD paths use the same IEEE
+// single ops in the same order as integrate_agents_scalar (compare-and-select
+// rather than min/max, so NaN and signed zeros follow clampf too), which makes
+// them bit-identical as long as the compiler does not contract a*b+c into FMA
+// (GCC's default under -std=c++17; avoid -ffp-contract=fast).
+static void integrate_agents_scalar(Agents& a,size_t from,size_t to,float dt,float w,float h){
+  for(size_t i=from;i<to;++i){
+    if(a.speedBoostT[i]>0.0f) a.speedBoostT[i] = std::max(0.0f, a.speedBoostT[i] - dt);
+
+    a.x[i] += a.vx[i]*dt; a.y[i] += a.vy[i]*dt;
+    a.x[i] = clampf(a.x[i],0,w); a.y[i] = clampf(a.y[i],0,h);
+
+    float baseDrain=4.0f;
+    float staminaFactor = 1.0f - 0.12f * (a.intel[i]/100.0f);
+    staminaFactor = clampf(staminaFactor,0.7f,1.0f);
+    float eDrain = baseDrain * staminaFactor;
+
+    a.energy[i] = clampf(a.energy[i] - eDrain*dt, 0, 100);
+    a.health[i] = clampf(a.health[i] - ((a.energy[i]<=0)?6.0f:1.0f)*dt, 0, 100);
+  }
+}
+
+#if defined(__AVX__) || defined(__SSE2__)
+#if defined(__AVX__)
+struct SimdF {
+  using V=__m256; static const size_t W=8;
+  static V load(const float* p){ return _mm256_loadu_ps(p); }
+  static void store(float* p,V v){ _mm256_storeu_ps(p,v); }
+  static V set(float f){ return _mm256_set1_ps(f); }
+  static V add(V a,V b){ return _mm256_add_ps(a,b); }
+  static V sub(V a,V b){ return _mm256_sub_ps(a,b); }
+  static V mul(V a,V b){ return _mm256_mul_ps(a,b); }
+  static V div(V a,V b){ return _mm256_div_ps(a,b); }
+  static V lt(V a,V b){ return _mm256_cmp_ps(a,b,_CMP_LT_OQ); }
+  static V gt(V a,V b){ return _mm256_cmp_ps(a,b,_CMP_GT_OQ); }
+  static V le(V a,V b){ return _mm256_cmp_ps(a,b,_CMP_LE_OQ); }
+  static V sel(V m,V a,V b){ return _mm256_blendv_ps(b,a,m); }  // m ? a : b
+};
+#else
+struct SimdF {
+  using V=__m128; static const size_t W=4;
+  static V load(const float* p){ return _mm_loadu_ps(p); }
+  static void store(float* p,V v){ _mm_storeu_ps(p,v); }
+  static V set(float f){ return _mm_set1_ps(f); }
+  static V add(V a,V b){ return _mm_add_ps(a,b); }
+  static V sub(V a,V b){ return _mm_sub_ps(a,b); }
+  static V mul(V a,V b){ return _mm_mul_ps(a,b); }
+  static V div(V a,V b){ return _mm_div_ps(a,b); }
+  static V lt(V a,V b){ return _mm_cmplt_ps(a,b); }
+  static V gt(V a,V b){ return _mm_cmpgt_ps(a,b); }
+  static V le(V a,V b){ return _mm_cmple_ps(a,b); }
+  static V sel(V m,V a,V b){ return _mm_or_ps(_mm_and_ps(m,a),_mm_andnot_ps(m,b)); }
+};
+#endif
+// Returns how many leading agents were processed; the rest go scalar.
+static size_t integrate_agents_simd(Agents& a,float dt,float w,float h){
+  using S=SimdF; using V=S::V;
+  const size_t n=a.size()/S::W*S::W;
+  const V vdt=S::set(dt), zero=S::set(0.0f), vw=S::set(w), vh=S::set(h);
+  const V c100=S::set(100.0f), c1=S::set(1.0f), c012=S::set(0.12f), c07=S::set(0.7f);
+  const V c4=S::set(4.0f), c6=S::set(6.0f);
+  auto clamp=[](V v,V lo,V hi){ return S::sel(S::lt(v,lo),lo,S::sel(S::gt(v,hi),hi,v)); };
+  for(size_t i=0;i<n;i+=S::W){
+    V sb=S::load(&a.speedBoostT[i]);
+    V dec=S::sub(sb,vdt);
+    dec=S::sel(S::lt(zero,dec),dec,zero);                  // std::max(0,dec)
+    S::store(&a.speedBoostT[i],S::sel(S::gt(sb,zero),dec,sb));
+
+    V x=S::add(S::load(&a.x[i]),S::mul(S::load(&a.vx[i]),vdt));
+    V y=S::add(S::load(&a.y[i]),S::mul(S::load(&a.vy[i]),vdt));
+    S::store(&a.x[i],clamp(x,zero,vw)); S::store(&a.y[i],clamp(y,zero,vh));
+
+    V stamina=S::sub(c1,S::mul(c012,S::div(S::load(&a.intel[i]),c100)));
+    stamina=clamp(stamina,c07,c1);
+    V eDrain=S::mul(c4,stamina);
+    V e=clamp(S::sub(S::load(&a.energy[i]),S::mul(eDrain,vdt)),zero,c100);
+    S::store(&a.energy[i],e);
+    V hd=S::sel(S::le(e,zero),c6,c1);
+    S::store(&a.health[i],clamp(S::sub(S::load(&a.health[i]),S::mul(hd,vdt)),zero,c100));
+  }
+  return n;
+}
+#endif
+
+static void integrate_agents(Agents& a,float dt,float w,float h){
+  size_t done=0;
+#if defined(__AVX__) || defined(__SSE2__)
+  done=integrate_agents_simd(a,dt,w,h);
+#endif
+  integrate_agents_scalar(a,done,a.size(),dt,w,h);
+}
+
+// Dense entity storage with O(1) kill(). Killed entries stay in place, flagged,
+// until flush() compacts them all in one ordered pass at the end of the tick,
+// so indices held by a SpatialGrid stay valid for the whole tick and the
+// surviving order (which brain.py sees) is the same as with per-pickup erase.
+template<class T> struct EntityPool {
+  std::vector<T> items;
+  std::vector<uint8_t> dead;
+  size_t pending=0, firstDead=0;
+
+  size_t size() const { return items.size(); }
+  bool alive(size_t i) const { return !dead[i]; }
+  T& operator[](size_t i){ return items[i]; }
+  const T& operator[](size_t i) const { return items[i]; }
+  // Iteration sees killed entries too until the next flush().
+  typename std::vector<T>::const_iterator begin() const { return items.begin(); }
+  typename std::vector<T>::const_iterator end() const { return items.end(); }
+  void reserve(size_t n){ items.reserve(n); dead.reserve(n); }
+  void push(const T& v){ items.push_back(v); dead.push_back(0); }
+  void kill(size_t i){
+    if(dead[i]) return;
+    dead[i]=1;
+    firstDead = pending? std::min(firstDead,i) : i;
+    ++pending;
+  }
+  // Returns true if anything was removed (indices changed).
+  bool flush(){
+    if(!pending) return false;
+    size_t w=firstDead;
+    for(size_t r=firstDead;r<items.size();++r) if(!dead[r]) items[w++]=items[r];
+    items.resize(w); dead.assign(w,0);
+    pending=0;
+    return true;
+  }
+};
+
+// Uniform bucket grid over the world. rebuild() counting-sorts item indices by
+// cell, so each cell lists its items in ascending index order; query() visits
+// every item in the cells overlapping a circle (padded a little against float
+// rounding) and leaves the exact distance test to the caller.
+struct SpatialGrid {
+  float cell=80.0f, inv=1.0f/80.0f;
+  int cols=1, rows=1;
+  std::vector<int32_t> start;   // cols*rows+1 offsets into items
+  std::vector<int32_t> items;
+  std::vector<int32_t> cellOf, cursor;  // rebuild scratch
+
+  void init(float w,float h,float cellSize){
+    cell=cellSize; inv=1.0f/cellSize;
+    cols=std::max(1,(int)std::ceil(w*inv)); rows=std::max(1,(int)std::ceil(h*inv));
+    start.assign((size_t)cols*rows+1,0);
+    items.clear();
+  }
+  void reserve(size_t n){ items.reserve(n); cellOf.reserve(n); }
+  int col(float x) const { int c=(int)(x*inv); return c<0?0:(c>=cols?cols-1:c); }
+  int row(float y) const { int r=(int)(y*inv); return r<0?0:(r>=rows?rows-1:r); }
+  // xy(i,x,y) fills the position of item i.
+  template<class XY> void rebuild(size_t n,XY&& xy){
+    std::fill(start.begin(),start.end(),0);
+    cellOf.resize(n); items.resize(n);
+    for(size_t i=0;i<n;++i){
+      float x,y; xy(i,x,y);
+      int c=row(y)*cols+col(x);
+      cellOf[i]=c; ++start[c+1];
+    }
+    for(size_t c=1;c<start.size();++c) start[c]+=start[c-1];
+    cursor.assign(start.begin(),start.end()-1);
+    for(size_t i=0;i<n;++i) items[cursor[cellOf[i]]++]=(int32_t)i;
+  }
+  template<class F> void query(float x,float y,float r,F&& f) const {
+    r+=1.0f;
+    query_rect(x-r,y-r,x+r,y+r,f);
+  }
+  // Every item in the cells overlapping [x0,x1] x [y0,y1], cell by cell.
+  template<class F> void query_rect(float x0,float y0,float x1,float y1,F&& f) const {
+    int c0=col(x0), c1=col(x1), r0=row(y0), r1=row(y1);
+    for(int ry=r0;ry<=r1;++ry)
+      for(int cx=c0;cx<=c1;++cx){
+        int c=ry*cols+cx;
+        for(int32_t k=start[c];k<start[c+1];++k) f(items[k]);
+      }
+  }
+  // Item with the smallest d2(i), ties to the lower index (what a linear scan
+  // keeping the first minimum returns), or -1 if empty. Visits rings of cells
+  // around (x,y) until nothing further out can be as close as the best so far.
+  template<class D2> int32_t nearest(float x,float y,D2&& d2,double& best) const {
+    const int cx=col(x), cy=row(y), maxRing=std::max(cols,rows);
+    int32_t bi=-1; best=0;
+    // A few items (crates) in a big world would mean walking most of its
+    // rings; checking each item is cheaper then and picks the same one.
+    if(items.size()<=64){
+      for(int32_t i:items){
+        const double d=d2(i);
+        if(bi<0 || d<best || (d==best && i<bi)){ best=d; bi=i; }
+      }
+      return bi;
+    }
+    for(int k=0;k<=maxRing;++k){
+      for(int ry=cy-k;ry<=cy+k;++ry){
+        if(ry<0 || ry>=rows) continue;
+        const bool edge=(ry==cy-k || ry==cy+k);
+        for(int rx=cx-k;rx<=cx+k;rx+=(edge||k==0)?1:2*k){
+          if(rx<0 || rx>=cols) continue;
+          const int c=ry*cols+rx;
+          for(int32_t j=start[c];j<start[c+1];++j){
+            const int32_t i=items[j];
+            const double d=d2(i);
+            if(bi<0 || d<best || (d==best && i<bi)){ best=d; bi=i; }
+          }
+        }
+      }
+      // Cells in ring k+1 are more than k cells away (less a pixel of rounding slack).
+      const double reach=k*(double)cell-1.0;
+      if(bi>=0 && reach>0 && best<reach*reach) break;
+    }
+    return bi;
+  }
+};
+
+// One self-contained world: agents, coins, crates, its own RNG, spawn timer,
+// neighbour grids and reward queue. Worlds share nothing, so several can step
+// on different threads. A tick is begin_tick(), then the brain decides from
+// the current state, then advance() applies those decisions.
+struct World {
+  Agents players;
+  EntityPool<Coin> coins;
+  EntityPool<Crate> crates;
+  std::mt19937 rng;
+  double crateSpawnTimer=10.0;
+  double dt=1.0/60.0;
+  long tick=0;
+  RewardQueue rewards;
+
+  // Neighbour index for separation and pickups. Cells match the 80 px
+  // separation radius, which also covers the 40/45 px pickup radii.
+  SpatialGrid playerGrid, coinGrid, crateGrid;
+  bool playerGridStale=true, coinGridStale=true, crateGridStale=true;
+  std::vector<int32_t> hits;
+  uint64_t phaseNs[PH_SIM_COUNT]={};  // time spent in observe()/advance(), drained by the runner
+
+  // What the brain would otherwise work out itself each tick, per agent, for
+  // the state it decides on: the nearest coin and crate (distance -1 if the
+  // world has none) and how many agents within 200 px are richer (foes) or
+  // not (friends) in coins+food. Distances are compared in double precision
+  // from the float positions, exactly as brain.py did, so results match its
+  // scans. Filled by observe(), once per tick.
+  struct Features {
+    std::vector<float> coinXY, coinDist, crateXY, crateDist;
+    std::vector<int32_t> crateType, friends, foes;
+    long tick=-1;
+  } feat;
+
+  explicit World(uint32_t seed=1337,int nPlayers=25,int startCoins=0,const std::string& prefix=""):rng(seed){
+    players.reserve(nPlayers);
+    // Square-ish grid; the stock 25 players get the original 5x5 layout.
+    const int cols=std::max(5,(int)std::ceil(std::sqrt((double)nPlayers)));
+    const int rowsM1=std::max(1,(nPlayers/cols)-1 + ((nPlayers%cols)?1:0));
+    for(int i=0;i<nPlayers;++i){
+      float gx=(i%cols), gy=(i/cols);
+      players.add(prefix+"Player"+std::to_string(i+1),
+                  200.0f + gx*((WORLD_W-400.0f)/(cols-1)),
+                  300.0f + gy*((WORLD_H-600.0f)/rowsM1));
+    }
+    for(int i=0;i<startCoins;++i){
+      float cx=randf(10.0f,WORLD_W-10.0f), cy=randf(10.0f,WORLD_H-10.0f);
+      coins.push({cx,cy});
+    }
+    rewards.ev.reserve(1024);
+    // Scratch that only ever grows, sized up front so the tick loop does not
+    // allocate once it is running (main.cpp --alloc-check).
+    hits.reserve(nPlayers+64);
+    crates.reserve(64);
+    playerGrid.init(WORLD_W,WORLD_H,80.0f); coinGrid.init(WORLD_W,WORLD_H,80.0f); crateGrid.init(WORLD_W,WORLD_H,80.0f);
+    playerGrid.reserve(nPlayers); coinGrid.reserve(startCoins+64); crateGrid.reserve(64);
+  }
+
+  float randf(float a,float b){ std::uniform_real_distribution<float> d(a,b); return d(rng); }
+  int randi(int a,int b){ std::uniform_int_distribution<int> d(a,b); return d(rng); }
+
+  void drop_coin(float x,float y){ coins.push({x,y}); coinGridStale=true; }
+  void spawn_crate(float x,float y){
+    Crate c; c.x=x; c.y=y;
+    int pick=randi(0,3);
+    c.t = pick==0?CrateType::Coins3 : pick==1?CrateType::Food1 : pick==2?CrateType::Speed8s : CrateType::Heal30;
+    crates.push(c);
+    crateGridStale=true;
+  }
+
+  static void gain_intel(Player p,float amount){ p.intel=clampf(p.intel+amount,0.0f,100.0f); }
+
+  void apply_transactions(size_t i){
+    Player p(players,i);
+    if(in_rect(STORE,p.x,p.y)){
+      int reserve = std::min(3, 1 + (int)std::floor(p.intel / 40.0f));
+      if(p.coins>=5 && p.food < reserve){
+        p.coins -= 5; p.food += 1; gain_intel(p, 0.5f);
+        rewards.push(i, +0.8, R_BUY_FOOD_RESERVE);
+      }
+      bool lowHealth = (p.health <= 70.0f);
+      bool lowEnergy = (p.energy <= 60.0f);
+      if(p.food>0 && (lowHealth || lowEnergy)){
+        p.food -= 1;
+        p.health = clampf(p.health + 25.0f, 0, 100);
+        p.energy = clampf(p.energy + 20.0f, 0, 100);
+        gain_intel(p, 0.5f);
+        rewards.push(i, +1.0, R_EAT_FOOD_DELAYED);
+      }
+    }
+    if(in_rect(RECHARGE,p.x,p.y)){
+      float before=p.energy;
+      p.energy=clampf(p.energy + 30.0f*(float)dt, 0, 100);
+      if(p.energy>before) rewards.push(i, +0.2, R_RECHARGE);
+    }
+    if(p.food >= 1 && p.health > 70.0f && p.energy > 60.0f){
+      rewards.push(i, +0.02, R_MAINTAIN_FOOD_RESERVE);
+    }
+  }
+
+  void collect_coins(size_t pi){
+    Player p(players,pi);
+    rebuild_item_grids();
+    // Every coin pays the same, so visiting order does not matter here.
+    coinGrid.query(p.x,p.y,40.0f,[&](int32_t k){
+      if(coins.alive(k) && dist2(p.x,p.y,coins[k].x,coins[k].y) <= 40.0f*40.0f){
+        coins.kill(k);
+        p.coins += 1; p.perf+=0.5f; gain_intel(p, 0.25f);
+        rewards.push(pi, +1.0, R_COLLECT_COIN);
+      }
+    });
+  }
+
+  void collect_crates(size_t pi){
+    Player p(players,pi);
+    rebuild_item_grids();
+    hits.clear();
+    crateGrid.query(p.x,p.y,45.0f,[&](int32_t k){
+      if(crates.alive(k) && dist2(p.x,p.y,crates[k].x,crates[k].y) <= 45.0f*45.0f) hits.push_back(k);
+    });
+    if(hits.empty()) return;
+    std::sort(hits.begin(),hits.end());
+    for(int32_t k:hits){
+      switch(crates[k].t){
+        case CrateType::Coins3:
+          p.coins += 3; p.perf += 1.0f; p.status="CRATE: +3 coins";
+          rewards.push(pi, +1.2, R_CRATE_COINS3);
+          break;
+        case CrateType::Food1:
+          p.food = std::min(p.food+1, 9); p.perf += 0.8f; p.status="CRATE: +1 food";
+          rewards.push(pi, +1.0, R_CRATE_FOOD1);
+          break;
+        case CrateType::Speed8s:
+          p.speedBoostT = std::max(p.speedBoostT, 8.0f); p.perf += 0.8f; p.status="CRATE: speed x1.5 (8s)";
+          rewards.push(pi, +0.8, R_CRATE_SPEED);
+          break;
+        case CrateType::Heal30:
+          p.health = clampf(p.health + 30.0f, 0, 100); p.perf += 0.8f; p.status="CRATE: +30 health";
+          rewards.push(pi, +0.8, R_CRATE_HEAL30);
+          break;
+      }
+    }
+    for(int32_t k:hits) crates.kill(k);
+  }
+
+  // Tick bookkeeping that happens before the brain looks at the world; the
+  // crate timer runs on sim time, not wall time.
+  void begin_tick(){
+    ++tick;
+    crateSpawnTimer -= dt;
+    if(crateSpawnTimer<=0.0){
+      float cx=randf(60.0f, WORLD_W-60.0f), cy=randf(100.0f, WORLD_H-60.0f);
+      spawn_crate(cx,cy);
+      crateSpawnTimer = randf(12.0f, 22.0f);
+    }
+  }
+
+  void rebuild_player_grid(){
+    if(!playerGridStale) return;
+    const float* px=players.x.data(); const float* py=players.y.data();
+    playerGrid.rebuild(players.size(),[&](size_t k,float& x,float& y){ x=px[k]; y=py[k]; });
+    playerGridStale=false;
+  }
+  void rebuild_item_grids(){
+    if(coinGridStale){
+      coinGrid.rebuild(coins.size(),[&](size_t k,float& x,float& y){ x=coins[k].x; y=coins[k].y; });
+      coinGridStale=false;
+    }
+    if(crateGridStale){
+      crateGrid.rebuild(crates.size(),[&](size_t k,float& x,float& y){ x=crates[k].x; y=crates[k].y; });
+      crateGridStale=false;
+    }
+  }
+
+  // Fills `feat` for the current tick (after begin_tick and any input). The
+  // player grid built here is the one advance() separates with.
+  void observe(){
+    if(feat.tick==tick) return;
+    uint64_t t0=prof_now_ns();
+    const size_t n=players.size();
+    Features& f=feat;
+    f.coinXY.resize(2*n); f.coinDist.resize(n); f.crateXY.resize(2*n); f.crateDist.resize(n);
+    f.crateType.resize(n); f.friends.resize(n); f.foes.resize(n);
+    rebuild_player_grid();
+    rebuild_item_grids();
+    const float* px=players.x.data(); const float* py=players.y.data();
+    for(size_t i=0;i<n;++i){
+      const double x=px[i], y=py[i];
+      const int sm=players.coins[i]+players.food[i];
+      int fr=0, fo=0;
+      playerGrid.query(px[i],py[i],200.0f,[&](int32_t j){
+        if((size_t)j==i) return;
+        const double dx=x-(double)px[j], dy=y-(double)py[j];
+        if(dx*dx+dy*dy<=200.0*200.0){ if(players.coins[j]+players.food[j]>sm) ++fo; else ++fr; }
+      });
+      f.friends[i]=fr; f.foes[i]=fo;
+
+      double d2;
+      int32_t k=coinGrid.nearest(px[i],py[i],[&](int32_t c){
+        const double dx=x-(double)coins[c].x, dy=y-(double)coins[c].y; return dx*dx+dy*dy; },d2);
+      if(k>=0){ f.coinXY[2*i]=coins[k].x; f.coinXY[2*i+1]=coins[k].y; f.coinDist[i]=(float)std::sqrt(d2); }
+      else { f.coinXY[2*i]=f.coinXY[2*i+1]=0; f.coinDist[i]=-1; }
+      k=crateGrid.nearest(px[i],py[i],[&](int32_t c){
+        const double dx=x-(double)crates[c].x, dy=y-(double)crates[c].y; return dx*dx+dy*dy; },d2);
+      if(k>=0){
+        f.crateXY[2*i]=crates[k].x; f.crateXY[2*i+1]=crates[k].y; f.crateDist[i]=(float)std::sqrt(d2);
+        f.crateType[i]=(int32_t)crates[k].t;
+      } else { f.crateXY[2*i]=f.crateXY[2*i+1]=0; f.crateDist[i]=-1; f.crateType[i]=-1; }
+    }
+    f.tick=tick;
+    phaseNs[PH_FEATURES]+=prof_now_ns()-t0;
+  }
+
+  // Applies one decision frame (2 floats + 1 intent per agent) and runs the
+  // rest of the tick. Rewards accumulate in `rewards` for the caller.
+  void advance(const float* outVel,const int32_t* outIntent,bool decided){
+    uint64_t t0=prof_now_ns();
+    for(size_t i=0;i<players.size();++i){
+      float vx=outVel[2*i], vy=outVel[2*i+1];
+      float boost = (players.speedBoostT[i]>0.0f ? 1.5f : 1.0f);
+      players.vx[i] = vx*boost; players.vy[i] = vy*boost;
+    }
+
+    const float sepRadius=80.0f, sepRadius2=sepRadius*sepRadius;
+    const float sepStrength=320.0f, maxSpeed=220.0f, maxAccel=600.0f;
+    float* px=players.x.data(); float* py=players.y.data();
+    float* pvx=players.vx.data(); float* pvy=players.vy.data();
+    rebuild_player_grid();
+    for(size_t i=0;i<players.size();++i){
+      float ax=0, ay=0;
+      // Visit neighbours in index order so the float sums match a full scan.
+      hits.clear();
+      playerGrid.query(px[i],py[i],sepRadius,[&](int32_t j){ hits.push_back(j); });
+      std::sort(hits.begin(),hits.end());
+      for(int32_t jj:hits){
+        size_t j=(size_t)jj;
+        if(i==j) continue;
+        float d2=dist2(px[i],py[i],px[j],py[j]);
+        if(d2<sepRadius2 && d2>1.0f){
+          float d=std::sqrt(d2);
+          float nx=(px[i]-px[j])/d, ny=(py[i]-py[j])/d;
+          float w=(sepRadius - d)/sepRadius;
+          ax += nx*sepStrength*w; ay += ny*sepStrength*w;
+          rewards.push(i, -0.02*w, R_TOO_CLOSE);
+        }
+      }
+      float alen=std::sqrt(ax*ax+ay*ay);
+      if(alen>maxAccel){ ax*=maxAccel/alen; ay*=maxAccel/alen; }
+      pvx[i] += ax*(float)dt; pvy[i] += ay*(float)dt;
+      float vlen=std::sqrt(pvx[i]*pvx[i]+pvy[i]*pvy[i]);
+      if(vlen>maxSpeed){ pvx[i]*=maxSpeed/vlen; pvy[i]*=maxSpeed/vlen; }
+    }
+
+    uint64_t t1=prof_now_ns();
+    integrate_agents(players,(float)dt,(float)WORLD_W,(float)WORLD_H);
+    uint64_t t2=prof_now_ns();
+
+    // Per-agent rules stay scalar and in index order: deaths, then the
+    // transactions and pickups that touch shared coins/crates.
+    for(size_t i=0;i<players.size();++i){
+      Player p(players,i);
+      if(p.health<=0){
+        p.deaths += 1;
+        p.x=WORLD_W*0.5f; p.y=WORLD_H*0.5f; p.vx=0; p.vy=0;
+        p.health=100; p.energy=60;
+        p.coins=std::max(0,p.coins-1);
+        p.status=nullptr;
+        rewards.push(i, -2.0, R_DEATH);
+      }
+
+      apply_transactions(i);
+      collect_coins(i);
+      collect_crates(i);
+
+      int ic=outIntent[i];
+      p.intent = (decided && ic>=0 && ic<INTENT_COUNT)? ic : -1;
+    }
+
+    // Deferred removals: one compaction per tick, then the grids re-index.
+    if(coins.flush()) coinGridStale=true;
+    if(crates.flush()) crateGridStale=true;
+    playerGridStale=true;
+    uint64_t t3=prof_now_ns();
+    phaseNs[PH_SEPARATION]+=t1-t0; phaseNs[PH_INTEGRATE]+=t2-t1; phaseNs[PH_RULES]+=t3-t2;
+  }
+};
+
+// Fixed set of threads for fork-join loops over independent items (worlds).
+// run() hands out indices from a shared counter, the calling thread works
+// too, and it returns once every index is done. A pool of 1 runs inline.
+struct WorkerPool {
+  std::vector<std::thread> threads;
+  std::mutex m;
+  std::condition_variable cvWork, cvDone;
+  const void* ctx=nullptr;
+  void (*call)(const void*,size_t)=nullptr;
+  size_t count=0;
+  std::atomic<size_t> next{0};
+  size_t busy=0;
+  unsigned gen=0;
+  bool quit=false;
+
+  explicit WorkerPool(int n){
+    for(int t=1;t<n;++t) threads.emplace_back([this]{ loop(); });
+  }
+  ~WorkerPool(){
+    { std::lock_guard<std::mutex> lk(m); quit=true; }
+    cvWork.notify_all();
+    for(std::thread& t:threads) t.join();
+  }
+  size_t size() const { return threads.size()+1; }
+
+  template<class F> void run(size_t n,const F& f){
+    if(threads.empty() || n<2){ for(size_t i=0;i<n;++i) f(i); return; }
+    {
+      std::lock_guard<std::mutex> lk(m);
+      ctx=&f; call=[](const void* c,size_t i){ (*(const F*)c)(i); };
+      count=n; next=0; busy=threads.size(); ++gen;
+    }
+    cvWork.notify_all();
+    work();
+    std::unique_lock<std::mutex> lk(m);
+    cvDone.wait(lk,[&]{ return busy==0; });
+  }
+
+private:
+  void work(){
+    for(size_t i=next.fetch_add(1);i<count;i=next.fetch_add(1)) call(ctx,i);
+  }
+  void loop(){
+    unsigned seen=0;
+    std::unique_lock<std::mutex> lk(m);
+    for(;;){
+      cvWork.wait(lk,[&]{ return quit || gen!=seen; });
+      if(quit) return;
+      seen=gen;
+      lk.unlock();
+      work();
+      lk.lock();
+      if(--busy==0) cvDone.notify_one();
+    }
+  }
+};
@@ -0,0 +1,75 @@
+// What the render thread draws: a copy of world 0 taken by the sim thread
+// after its latest tick, handed over through a lock-free triple buffer so
+// neither thread ever waits on the other. No SDL or GL in here.
+#pragma once
+
+#include "sim.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Single-writer/single-reader triple buffer. The writer fills back() and
+// publish() swaps it with the shared middle slot; the reader's acquire() takes
+// the middle slot if anything newer was published since its last one. Each
+// side only ever touches its own slot, so neither locks nor waits, and the
+// reader always holds one complete value.
+template<class T> struct TripleBuffer {
+  T slots[3];
+
+  T& back(){ return slots[backIdx]; }
+  const T& front() const { return slots[frontIdx]; }
+  T& front(){ return slots[frontIdx]; }
+  void publish(){ backIdx=mid.exchange(backIdx|FRESH,std::memory_order_acq_rel)&IDX; }
+  // True if front() is now a newer value.
+  bool acquire(){
+    if(!(mid.load(std::memory_order_relaxed)&FRESH)) return false;
+    frontIdx=mid.exchange(frontIdx,std::memory_order_acq_rel)&IDX;
+    return true;
+  }
+
+private:
+  static constexpr uint8_t IDX=3, FRESH=4;
+  std::atomic<uint8_t> mid{1};   // slot index, FRESH if the reader hasn't taken it yet
+  uint8_t backIdx=0;             // writer's
+  uint8_t frontIdx=2;            // reader's
+};
+
+// One tick of world 0 as the window shows it. Slots are reused, so after the
+// first few ticks taking a snapshot only copies into existing capacity.
+struct WorldSnapshot {
+  static constexpr float TILE=256.0f;   // cull index cell, px
+  long tick=0;
+  uint64_t takenNs=0;                   // prof_now_ns() when taken
+  Agents players;                       // names copied once; they never change
+  std::vector<float> prevX, prevY;      // positions one tick earlier, to interpolate from
+  std::vector<Coin> coins;
+  std::vector<Crate> crates;
+  SpatialGrid coinTiles, crateTiles;    // coins/crates by TILE cell, for culling against the view
+  // HUD lines for the agents the window asked about (index into players).
+  std::vector<int32_t> hudAgent;
+  std::vector<std::string> hudText;
+  // Sim phase stats for the F2 overlay, filled when asked for.
+  bool hasStats=false;
+  Profiler::Stats simStats[PH_SIM_COUNT];
+
+  void take(const World& w,const std::vector<float>& px,const std::vector<float>& py){
+    const Agents& a=w.players;
+    Agents& s=players;
+    s.x=a.x; s.y=a.y; s.vx=a.vx; s.vy=a.vy; s.health=a.health; s.energy=a.energy;
+    s.intel=a.intel; s.speedBoostT=a.speedBoostT; s.perf=a.perf;
+    s.coins=a.coins; s.food=a.food; s.deaths=a.deaths; s.intent=a.intent; s.status=a.status;
+    if(s.name.size()!=a.name.size()) s.name=a.name;
+    prevX=px; prevY=py;
+    coins.assign(w.coins.begin(),w.coins.end());
+    crates.assign(w.crates.begin(),w.crates.end());
+    if(coinTiles.start.empty()){
+      coinTiles.init(WORLD_W,WORLD_H,TILE); crateTiles.init(WORLD_W,WORLD_H,TILE);
+    }
+    coinTiles.rebuild(coins.size(),[&](size_t k,float& x,float& y){ x=coins[k].x; y=coins[k].y; });
+    crateTiles.rebuild(crates.size(),[&](size_t k,float& x,float& y){ x=crates[k].x; y=crates[k].y; });
+    tick=w.tick;
+    takenNs=prof_now_ns();
+  }
+};
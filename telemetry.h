@@ -0,0 +1,224 @@
+// Per-tick telemetry in a named POSIX shared-memory segment (--telemetry NAME),
+// so dashboards and tools (telemetry_reader.cpp) can watch a headless or
+// remote run without the window's stats panel.
+//
+// Layout: TeleHeader (with the current tick's TeleStats), then one array per
+// TeleField with a value per agent (world-major, like the bridge), then the
+// agent names, '\n'-separated. The header, stats and arrays are guarded by a
+// seqlock: the writer makes `seq` odd, updates, and makes it even again, and
+// a reader copies whatever it needs and retries if `seq` moved meanwhile. The
+// writer never waits for readers, so any number of them can poll at any rate
+// without slowing the tick loop; names never change after open(). A writer
+// killed mid-update leaves `seq` odd for good, so readers give up after a
+// timeout instead of spinning, and can check the writer's pid.
+#pragma once
+
+#include "sim.h"
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static const char TELE_MAGIC[8]={'E','C','O','T','E','L','E','1'};
+
+// Per-agent arrays; the first TF_FLOATS hold floats, the rest int32.
+enum TeleField : int { TF_HEALTH, TF_ENERGY, TF_INTEL, TF_PERF, TF_COINS, TF_FOOD, TF_DEATHS, TF_INTENT, TF_COUNT };
+static const int TF_FLOATS=TF_COINS;
+
+// The current tick: aggregates over every world, plus reward totals per
+// reason since the run started (readers diff them for rates).
+struct TeleStats {
+  int64_t tick=0;                    // 0 until the first tick is published
+  int32_t running=1;                 // 0 once the run has ended
+  uint32_t coinsOnGround=0, crates=0;
+  uint32_t intentCount[INTENT_COUNT+1]={};   // [INTENT_COUNT]: no intent this tick
+  double meanHealth=0, meanEnergy=0, meanIntel=0, meanPerf=0, maxPerf=0;
+  int64_t coinsHeld=0, foodHeld=0, deaths=0;
+  double rewardSum[R_COUNT]={};
+  uint64_t rewardCount[R_COUNT]={};
+};
+
+struct TeleHeader {
+  char magic[8];
+  uint32_t version=2, headerBytes=sizeof(TeleHeader);
+  uint64_t bytes=0;                  // whole segment
+  uint32_t agents=0, worlds=0;
+  int32_t pid=0;                     // the writer
+  double dt=1.0/60.0;
+  uint64_t fieldOff[TF_COUNT]={}, namesOff=0, namesLen=0;
+  std::atomic<uint64_t> seq{0};      // odd while the writer is mid-update
+  TeleStats s;
+};
+static_assert(std::atomic<uint64_t>::is_always_lock_free,"the seqlock counter is shared between processes");
+
+static std::string tele_shm_name(const std::string& n){ return n.empty() || n[0]=='/'? n : "/"+n; }
+
+// Owned by the tick thread: publish() once per tick, close() at the end.
+struct TelemetryWriter {
+  std::string name;
+  uint8_t* base=nullptr; size_t bytes=0;
+  TeleHeader* h=nullptr;
+  TeleStats s;                       // the writer's copy, reward totals accumulate here
+
+  bool open(const std::string& segName,const std::vector<std::string>& names,size_t worlds,double dt){
+    name=tele_shm_name(segName);
+    std::string blob;
+    for(const std::string& n:names){ blob+=n; blob+='\n'; }
+    auto align=[](size_t v){ return (v+63)&~(size_t)63; };
+    const size_t n=names.size();
+    uint64_t off[TF_COUNT];
+    size_t at=align(sizeof(TeleHeader));
+    for(int f=0;f<TF_COUNT;++f){ off[f]=at; at=align(at+n*4); }
+    const size_t namesOff=at; at+=blob.size();
+
+    int fd=shm_open(name.c_str(),O_CREAT|O_RDWR|O_TRUNC,0644);
+    if(fd<0){ std::perror(name.c_str()); return false; }
+    void* p=MAP_FAILED;
+    if(ftruncate(fd,(off_t)at)==0) p=mmap(nullptr,at,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+    ::close(fd);
+    if(p==MAP_FAILED){ std::perror(name.c_str()); shm_unlink(name.c_str()); return false; }
+    base=(uint8_t*)p; bytes=at;
+    h=new(base) TeleHeader();
+    h->bytes=at; h->agents=(uint32_t)n; h->worlds=(uint32_t)worlds; h->pid=(int32_t)getpid(); h->dt=dt;
+    for(int f=0;f<TF_COUNT;++f) h->fieldOff[f]=off[f];
+    h->namesOff=namesOff; h->namesLen=blob.size();
+    std::memcpy(base+namesOff,blob.data(),blob.size());
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(h->magic,TELE_MAGIC,8);   // last: a reader that sees the magic sees a laid-out segment
+    return true;
+  }
+
+  // Call after the worlds advanced and before their rewards are gathered, so
+  // this tick's reward events are still in each world's queue.
+  void publish(long tick,const std::vector<World>& worlds){
+    if(!h) return;
+    size_t n=0;
+    double hp=0, en=0, iq=0, pf=0, maxPf=0;
+    int64_t coinsHeld=0, food=0, deaths=0;
+    uint32_t ground=0, crates=0;
+    std::fill(std::begin(s.intentCount),std::end(s.intentCount),0u);
+    for(const World& w:worlds){
+      const Agents& a=w.players;
+      for(size_t i=0;i<a.size();++i){
+        hp+=a.health[i]; en+=a.energy[i]; iq+=a.intel[i]; pf+=a.perf[i];
+        if(n+i==0 || a.perf[i]>maxPf) maxPf=a.perf[i];
+        coinsHeld+=a.coins[i]; food+=a.food[i]; deaths+=a.deaths[i];
+        const int32_t k=a.intent[i];
+        ++s.intentCount[k>=0 && k<INTENT_COUNT? k : INTENT_COUNT];
+      }
+      n+=a.size();
+      ground+=(uint32_t)w.coins.size(); crates+=(uint32_t)w.crates.size();
+      for(const RewardEvent& e:w.rewards.ev){ s.rewardSum[e.reason]+=e.value; ++s.rewardCount[e.reason]; }
+    }
+    const double inv=n? 1.0/(double)n : 0.0;
+    s.tick=tick; s.coinsOnGround=ground; s.crates=crates;
+    s.meanHealth=hp*inv; s.meanEnergy=en*inv; s.meanIntel=iq*inv; s.meanPerf=pf*inv; s.maxPerf=maxPf;
+    s.coinsHeld=coinsHeld; s.foodHeld=food; s.deaths=deaths;
+
+    begin_write();
+    h->s=s;
+    size_t at=0;
+    for(const World& w:worlds){
+      const Agents& a=w.players;
+      const size_t m=a.size();
+      auto put=[&](int f,const void* src){ std::memcpy(base+h->fieldOff[f]+at*4,src,m*4); };
+      put(TF_HEALTH,a.health.data()); put(TF_ENERGY,a.energy.data()); put(TF_INTEL,a.intel.data()); put(TF_PERF,a.perf.data());
+      put(TF_COINS,a.coins.data()); put(TF_FOOD,a.food.data()); put(TF_DEATHS,a.deaths.data()); put(TF_INTENT,a.intent.data());
+      at+=m;
+    }
+    end_write();
+  }
+
+  // Marks the run as over for readers that still have it mapped, then removes the name.
+  void close(){
+    if(!h) return;
+    s.running=0;
+    begin_write(); h->s=s; end_write();
+    munmap(base,bytes);
+    shm_unlink(name.c_str());
+    base=nullptr; h=nullptr;
+  }
+  ~TelemetryWriter(){ close(); }
+
+private:
+  void begin_write(){
+    h->seq.store(h->seq.load(std::memory_order_relaxed)+1,std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+  void end_write(){ h->seq.store(h->seq.load(std::memory_order_relaxed)+1,std::memory_order_release); }
+};
+
+// Maps a segment read-only and takes consistent copies of it.
+struct TelemetryReader {
+  struct Frame {
+    TeleStats s;
+    std::vector<float> f[TF_FLOATS];
+    std::vector<int32_t> i[TF_COUNT-TF_FLOATS];
+    uint64_t seq=0;
+    int32_t in(TeleField k,size_t a) const { return i[k-TF_FLOATS][a]; }
+  };
+  const uint8_t* base=nullptr; size_t bytes=0;
+  const TeleHeader* h=nullptr;
+  std::vector<std::string> names;
+
+  bool open(const std::string& segName){
+    const std::string name=tele_shm_name(segName);
+    int fd=shm_open(name.c_str(),O_RDONLY,0);
+    if(fd<0){ std::perror(name.c_str()); return false; }
+    struct stat st;
+    void* p=MAP_FAILED;
+    if(fstat(fd,&st)==0 && (size_t)st.st_size>=sizeof(TeleHeader)){
+      bytes=(size_t)st.st_size;
+      p=mmap(nullptr,bytes,PROT_READ,MAP_SHARED,fd,0);
+    }
+    ::close(fd);
+    if(p==MAP_FAILED){ std::fprintf(stderr,"%s: not a telemetry segment\n",name.c_str()); return false; }
+    base=(const uint8_t*)p; h=(const TeleHeader*)p;
+    if(std::memcmp(h->magic,TELE_MAGIC,8)!=0 || h->version!=2 || h->headerBytes!=sizeof(TeleHeader) || h->bytes>bytes){
+      std::fprintf(stderr,"%s: not a telemetry segment (or an unsupported version)\n",name.c_str());
+      return false;
+    }
+    const char* s=(const char*)base+h->namesOff; const char* e=s+h->namesLen;
+    for(const char* q=s;q<e;){ const char* nl=(const char*)std::memchr(q,'\n',(size_t)(e-q)); if(!nl) nl=e; names.emplace_back(q,nl); q=nl+1; }
+    return true;
+  }
+  size_t agents() const { return h->agents; }
+
+  // Copies the latest tick; spins (briefly: the writer holds it for a few
+  // microseconds per tick) while an update is in progress. False if there was
+  // no consistent copy within timeoutMs, which means the writer died mid-update.
+  bool read(Frame& out,double timeoutMs=100.0) const {
+    const size_t n=h->agents;
+    for(auto& v:out.f) v.resize(n);
+    for(auto& v:out.i) v.resize(n);
+    using clock=std::chrono::steady_clock;
+    const auto deadline=clock::now()+std::chrono::duration<double,std::milli>(timeoutMs);
+    for(unsigned tries=1;;++tries){
+      const uint64_t s0=h->seq.load(std::memory_order_acquire);
+      if(!(s0&1)){
+        std::memcpy((void*)&out.s,(const void*)&h->s,sizeof(TeleStats));
+        for(int k=0;k<TF_COUNT;++k){
+          void* dst= k<TF_FLOATS? (void*)out.f[k].data() : (void*)out.i[k-TF_FLOATS].data();
+          std::memcpy(dst,base+h->fieldOff[k],n*4);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if(h->seq.load(std::memory_order_relaxed)==s0){ out.seq=s0; return true; }
+      }
+      if(tries%1024==0 && clock::now()>deadline) return false;
+    }
+  }
+  // False once the writing process is gone (it may have been killed without
+  // closing the segment). Only meaningful in the writer's pid namespace.
+  bool writer_alive() const { return h->pid<=0 || kill(h->pid,0)==0 || errno!=ESRCH; }
+  ~TelemetryReader(){ if(base) munmap((void*)base,bytes); }
+};
@@ -0,0 +1,117 @@
+// Tails the telemetry segment of a running app (--telemetry NAME) and prints
+// rolling stats: population averages, intents, rewards per reason over each
+// interval and the top agents by P. Reading never slows the app down.
+//
+// Built from telemetry.h and sim.h alone, no SDL or Python:
+//   g++ -std=c++17 -O2 telemetry_reader.cpp -o telemetry_reader
+//   ./telemetry_reader /ecosys --interval 2 --top 5
+#include "telemetry.h"
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct ReaderConfig {
+  std::string name="/ecosys";
+  double interval=1.0;   // seconds between reports
+  long count=0;          // 0 = until the run ends or Ctrl+C
+  int top=5;
+};
+
+static void usage(const char* argv0){
+  std::fprintf(stderr,
+    "usage: %s [NAME] [--interval S] [--count N] [--top K]\n"
+    "  NAME          shared-memory segment the app was started with (--telemetry NAME, default /ecosys)\n"
+    "  --interval S  seconds between reports (default 1)\n"
+    "  --count N     stop after N reports (default: until the run ends)\n"
+    "  --top K       list the K agents with the highest P (default 5, 0 = none)\n", argv0);
+}
+
+static bool parse_args(int argc,char** argv,ReaderConfig& cfg){
+  bool named=false;
+  for(int i=1;i<argc;++i){
+    std::string a=argv[i];
+    const char* v=(i+1<argc)? argv[i+1] : nullptr;
+    if(a=="--interval" && v){ cfg.interval=std::max(0.01,std::atof(v)); ++i; }
+    else if(a=="--count" && v){ cfg.count=std::max(0L,std::atol(v)); ++i; }
+    else if(a=="--top" && v){ cfg.top=std::max(0,std::atoi(v)); ++i; }
+    else if(!named && a.size() && a[0]!='-'){ cfg.name=a; named=true; }
+    else return false;
+  }
+  return true;
+}
+
+static volatile std::sig_atomic_t g_stop=0;
+static void on_sigint(int){ g_stop=1; }
+
+int main(int argc,char** argv){
+  ReaderConfig cfg;
+  if(!parse_args(argc,argv,cfg)){ usage(argv[0]); return 2; }
+  TelemetryReader tr;
+  if(!tr.open(cfg.name)) return 1;
+  std::signal(SIGINT,on_sigint);
+  std::signal(SIGTERM,on_sigint);
+  const size_t n=tr.agents();
+  std::printf("%s: %zu agents in %u world(s)\n",cfg.name.c_str(),n,tr.h->worlds);
+
+  using clock=std::chrono::steady_clock;
+  TelemetryReader::Frame prev, cur;
+  // A segment whose writer died keeps its last tick (or a half-written one);
+  // report that instead of printing it forever.
+  auto dead=[&](int64_t tick){
+    std::printf("the app (pid %d) stopped writing %s at tick %lld; it was probably killed\n",tr.h->pid,cfg.name.c_str(),(long long)tick);
+    return 1;
+  };
+  if(!tr.read(prev)) return dead(tr.h->s.tick);
+  if(prev.s.running && !tr.writer_alive()) return dead(prev.s.tick);
+  auto tPrev=clock::now();
+  std::vector<int32_t> order(n);
+  for(long reports=0;!g_stop && (cfg.count==0 || reports<cfg.count);++reports){
+    std::this_thread::sleep_for(std::chrono::duration<double>(cfg.interval));
+    if(!tr.read(cur)) return dead(prev.s.tick);
+    if(cur.s.running && cur.s.tick==prev.s.tick && !tr.writer_alive()) return dead(cur.s.tick);
+    auto tNow=clock::now();
+    const double secs=std::chrono::duration<double>(tNow-tPrev).count();
+    const TeleStats& s=cur.s;
+    const long ticks=(long)(s.tick-prev.s.tick);
+
+    std::printf("tick %lld  +%ld (%.1f ticks/s, %.1fx realtime)\n",(long long)s.tick,ticks,
+                secs>0? ticks/secs : 0.0, secs>0? ticks*tr.h->dt/secs : 0.0);
+    std::printf("  H %.1f  E %.1f  IQ %.1f  P %.1f (max %.0f)  coins %lld held, %u on the ground  food %lld  crates %u  deaths %lld (+%lld)\n",
+                s.meanHealth,s.meanEnergy,s.meanIntel,s.meanPerf,s.maxPerf,(long long)s.coinsHeld,s.coinsOnGround,
+                (long long)s.foodHeld,s.crates,(long long)s.deaths,(long long)(s.deaths-prev.s.deaths));
+    std::printf("  intents:");
+    for(int k=0;k<=INTENT_COUNT;++k)
+      if(s.intentCount[k]) std::printf("  %s %u",k<INTENT_COUNT? INTENT_NAMES[k] : "-",s.intentCount[k]);
+    std::printf("\n  rewards (count, sum):");
+    for(int r=0;r<R_COUNT;++r){
+      const uint64_t events=s.rewardCount[r]-prev.s.rewardCount[r];
+      if(events) std::printf("  %s %llux %+.1f",REWARD_NAMES[r],(unsigned long long)events,s.rewardSum[r]-prev.s.rewardSum[r]);
+    }
+    std::printf("\n");
+    if(cfg.top>0 && n){
+      for(size_t i=0;i<n;++i) order[i]=(int32_t)i;
+      const size_t k=std::min((size_t)cfg.top,n);
+      const std::vector<float>& perf=cur.f[TF_PERF];
+      std::partial_sort(order.begin(),order.begin()+k,order.end(),[&](int32_t a,int32_t b){
+        return perf[a]>perf[b] || (perf[a]==perf[b] && a<b);
+      });
+      std::printf("  top:");
+      for(size_t r=0;r<k;++r){
+        const size_t a=(size_t)order[r];
+        std::printf("  %s P %.0f C %d F %d D %d",tr.names[a].c_str(),perf[a],
+                    cur.in(TF_COINS,a),cur.in(TF_FOOD,a),cur.in(TF_DEATHS,a));
+      }
+      std::printf("\n");
+    }
+    std::fflush(stdout);
+    if(!s.running){ std::printf("run ended at tick %lld\n",(long long)s.tick); break; }
+    std::swap(prev,cur); tPrev=tNow;
+  }
+  return 0;
+}
@@ -0,0 +1,245 @@
+// Binary trajectory log: every tick's world state, the decisions applied,
+// user input and reward events, appended to a memory-mapped file.
+//
+// Layout: TrajHeader, then one block per tick:
+//   TrajTick | RewardEvent[nRewards] | uint32 coinCount[worlds] |
+//   uint32 crateCount[worlds] | TrajEvent[nEvents] | TrajAgent[agents] |
+//   Coin[sum coinCount] | TrajCrate[sum crateCount] | pad to 8 bytes
+// Every record type is fixed size and little-endian; world w's agents are
+// the w-th slice of TrajAgent, its coins/crates follow the count arrays.
+// States are taken at the end of the tick. Replaying starts fresh worlds from
+// the header's seed and steps them with the logged decisions and input, so a
+// log is also a check that the sim is deterministic.
+#pragma once
+
+#include "sim.h"
+
+#include <cstdio>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static const char TRAJ_MAGIC[8]={'E','C','O','T','R','A','J','1'};
+static const uint32_t TRAJ_TICK_MAGIC=0x4B434954; // "TICK"
+
+struct TrajHeader {
+  char magic[8];
+  uint32_t version=1, headerBytes=sizeof(TrajHeader);
+  int32_t worldW=WORLD_W, worldH=WORLD_H;
+  Rect store=STORE, recharge=RECHARGE;
+  uint32_t seed=0;
+  int32_t worlds=1, agentsPerWorld=0, startCoins=0;
+  double dt=1.0/60.0;
+  uint64_t ticks=0;        // filled in on close; 0 if the writer never closed
+  uint64_t bytes=0;        // end of the last complete block, kept current while writing
+};
+static_assert(sizeof(TrajHeader)%8==0,"blocks after the header stay 8-byte aligned");
+
+struct TrajTick {
+  uint32_t magic=TRAJ_TICK_MAGIC;
+  int32_t tick=0;
+  uint32_t bytes=0;        // whole block including padding
+  uint32_t decided=0;      // the brain produced decisions this tick
+  uint32_t nEvents=0, nRewards=0;
+  uint32_t nCoins=0, nCrates=0;
+};
+static_assert(sizeof(TrajTick)==32,"");
+
+struct TrajAgent {
+  float x,y,vx,vy,health,energy,intel,perf,speedBoostT;
+  int32_t coins,food,deaths;
+  float outVx,outVy;       // decision applied this tick (before boost/separation)
+  int32_t intent;
+};
+static_assert(sizeof(TrajAgent)==60,"");
+
+struct TrajCrate { float x,y; int32_t type; };
+
+// User input that changes a world outside the rules; applied before the tick.
+enum TrajEventKind : int32_t { EV_DROP_COIN=0, EV_SPAWN_CRATE=1 };
+struct TrajEvent { int32_t kind, world; float x,y; };
+
+// Serializes blocks into a RAM buffer on the tick thread; a writer thread
+// copies full buffers into the file through a window mapped in 64 MiB chunks
+// (grown with ftruncate), so the tick loop never waits on the disk.
+struct TrajWriter {
+  static constexpr size_t CHUNK=64u<<20, HANDOFF=1u<<20;
+  int fd=-1;
+  TrajHeader hdr;
+  std::vector<char> front;             // tick thread
+  std::vector<char> queued;            // guarded by m
+  std::mutex m;
+  std::condition_variable cv;
+  std::thread worker;
+  bool closing=false;
+  // writer thread
+  char* map=nullptr; size_t mapOff=0, mapLen=0, fileEnd=0;
+  bool ioError=false;
+
+  bool open(const char* path,const TrajHeader& h){
+    fd=::open(path,O_RDWR|O_CREAT|O_TRUNC,0644);
+    if(fd<0){ std::perror(path); return false; }
+    hdr=h; std::memcpy(hdr.magic,TRAJ_MAGIC,8);
+    front.reserve(HANDOFF*2);
+    put((const char*)&hdr,sizeof(hdr));
+    worker=std::thread([this]{ run(); });
+    return true;
+  }
+
+  template<class T> void append(const T* p,size_t n){
+    const char* b=(const char*)p;
+    front.insert(front.end(),b,b+n*sizeof(T));
+  }
+
+  void record(long tick,const std::vector<World>& worlds,const float* outVel,const int32_t* outIntent,
+              bool decided,const std::vector<TrajEvent>& events){
+    const size_t start=front.size();
+    TrajTick t; t.tick=(int32_t)tick; t.decided=decided; t.nEvents=(uint32_t)events.size();
+    for(const World& w:worlds){ t.nRewards+=w.rewards.ev.size(); t.nCoins+=w.coins.size(); t.nCrates+=w.crates.size(); }
+    append(&t,1);
+    int32_t off=0;
+    for(const World& w:worlds){
+      for(RewardEvent e:w.rewards.ev){ e.agent+=off; append(&e,1); }
+      off+=(int32_t)w.players.size();
+    }
+    for(const World& w:worlds){ uint32_t c=w.coins.size(); append(&c,1); }
+    for(const World& w:worlds){ uint32_t c=w.crates.size(); append(&c,1); }
+    append(events.data(),events.size());
+    size_t k=0;
+    for(const World& w:worlds){
+      const Agents& a=w.players;
+      for(size_t i=0;i<a.size();++i,++k){
+        TrajAgent r{a.x[i],a.y[i],a.vx[i],a.vy[i],a.health[i],a.energy[i],a.intel[i],a.perf[i],a.speedBoostT[i],
+                    a.coins[i],a.food[i],a.deaths[i],outVel[2*k],outVel[2*k+1],outIntent[k]};
+        append(&r,1);
+      }
+    }
+    for(const World& w:worlds) append(w.coins.items.data(),w.coins.size());
+    for(const World& w:worlds)
+      for(const Crate& c:w.crates){ TrajCrate r{c.x,c.y,(int32_t)c.t}; append(&r,1); }
+    front.resize((front.size()+7)&~(size_t)7,0);
+    uint32_t bytes=(uint32_t)(front.size()-start);
+    std::memcpy(front.data()+start+offsetof(TrajTick,bytes),&bytes,sizeof(bytes));
+    ++hdr.ticks;
+    if(front.size()>=HANDOFF) handoff();
+  }
+
+  void handoff(){
+    {
+      std::lock_guard<std::mutex> lk(m);
+      if(queued.empty()) std::swap(queued,front);
+      else queued.insert(queued.end(),front.begin(),front.end());  // writer is behind; keep going
+    }
+    front.clear();
+    cv.notify_one();
+  }
+
+  void close(){
+    if(fd<0) return;
+    handoff();
+    { std::lock_guard<std::mutex> lk(m); closing=true; }
+    cv.notify_one();
+    worker.join();
+    if(map) munmap(map,mapLen);
+    map=nullptr;
+    hdr.bytes=fileEnd;
+    if(ftruncate(fd,(off_t)fileEnd)!=0 || pwrite(fd,&hdr,sizeof(hdr),0)!=(ssize_t)sizeof(hdr)) ioError=true;
+    if(ioError) std::fprintf(stderr,"trajectory: write error, log may be incomplete\n");
+    ::close(fd); fd=-1;
+  }
+  ~TrajWriter(){ close(); }
+
+private:
+  void run(){
+    std::vector<char> buf;
+    for(;;){
+      {
+        std::unique_lock<std::mutex> lk(m);
+        cv.wait(lk,[&]{ return closing || !queued.empty(); });
+        if(queued.empty() && closing) return;
+        std::swap(buf,queued);
+      }
+      put(buf.data(),buf.size());
+      buf.clear();
+      // Buffers hold whole blocks, so this is a safe end to read up to after a crash.
+      uint64_t end=fileEnd;
+      if(!ioError && pwrite(fd,&end,sizeof(end),offsetof(TrajHeader,bytes))!=(ssize_t)sizeof(end)) ioError=true;
+    }
+  }
+  void put(const char* p,size_t n){
+    while(n && !ioError){
+      if(fileEnd>=mapOff+mapLen && !remap()) return;
+      size_t room=mapOff+mapLen-fileEnd, k=std::min(room,n);
+      std::memcpy(map+(fileEnd-mapOff),p,k);
+      fileEnd+=k; p+=k; n-=k;
+    }
+  }
+  bool remap(){
+    if(map) munmap(map,mapLen);
+    mapOff+=mapLen; mapLen=CHUNK;
+    map=nullptr;
+    if(ftruncate(fd,(off_t)(mapOff+mapLen))!=0){ ioError=true; return false; }
+    void* p=mmap(nullptr,mapLen,PROT_READ|PROT_WRITE,MAP_SHARED,fd,(off_t)mapOff);
+    if(p==MAP_FAILED){ ioError=true; mapLen=0; return false; }
+    map=(char*)p;
+    return true;
+  }
+};
+
+// Maps a whole log read-only and walks its tick blocks. A log from a run that
+// died without close() is read up to the last buffer the writer finished.
+struct TrajReader {
+  struct Tick {
+    const TrajTick* t=nullptr;
+    const RewardEvent* rewards=nullptr;
+    const uint32_t *coinCount=nullptr, *crateCount=nullptr;
+    const TrajEvent* events=nullptr;
+    const TrajAgent* agents=nullptr;
+    const Coin* coins=nullptr;
+    const TrajCrate* crates=nullptr;
+  };
+  const char* base=nullptr;
+  size_t mapped=0, size=0, pos=0, nAgents=0;
+  TrajHeader hdr;
+
+  bool open(const char* path){
+    int fd=::open(path,O_RDONLY);
+    if(fd<0){ std::perror(path); return false; }
+    struct stat st;
+    if(fstat(fd,&st)!=0 || (size_t)st.st_size<sizeof(TrajHeader)){ ::close(fd); std::fprintf(stderr,"%s: not a trajectory log\n",path); return false; }
+    size=mapped=(size_t)st.st_size;
+    void* p=mmap(nullptr,mapped,PROT_READ,MAP_PRIVATE,fd,0);
+    ::close(fd);
+    if(p==MAP_FAILED){ std::perror(path); return false; }
+    base=(const char*)p;
+    std::memcpy(&hdr,base,sizeof(hdr));
+    if(std::memcmp(hdr.magic,TRAJ_MAGIC,8)!=0 || hdr.version!=1 || hdr.headerBytes!=sizeof(TrajHeader)){
+      std::fprintf(stderr,"%s: not a trajectory log (or an unsupported version)\n",path);
+      return false;
+    }
+    if(hdr.bytes) size=std::min(size,(size_t)hdr.bytes);
+    madvise(p,size,MADV_SEQUENTIAL);
+    nAgents=(size_t)hdr.worlds*(size_t)hdr.agentsPerWorld;
+    pos=sizeof(TrajHeader);
+    return true;
+  }
+  bool next(Tick& out){
+    if(pos+sizeof(TrajTick)>size) return false;
+    const TrajTick* t=(const TrajTick*)(base+pos);
+    if(t->magic!=TRAJ_TICK_MAGIC || t->bytes<sizeof(TrajTick) || pos+t->bytes>size) return false;
+    const char* p=base+pos+sizeof(TrajTick);
+    out.t=t;
+    out.rewards=(const RewardEvent*)p;     p+=t->nRewards*sizeof(RewardEvent);
+    out.coinCount=(const uint32_t*)p;      p+=hdr.worlds*sizeof(uint32_t);
+    out.crateCount=(const uint32_t*)p;     p+=hdr.worlds*sizeof(uint32_t);
+    out.events=(const TrajEvent*)p;        p+=t->nEvents*sizeof(TrajEvent);
+    out.agents=(const TrajAgent*)p;        p+=nAgents*sizeof(TrajAgent);
+    out.coins=(const Coin*)p;              p+=t->nCoins*sizeof(Coin);
+    out.crates=(const TrajCrate*)p;
+    pos+=t->bytes;
+    return true;
+  }
+  ~TrajReader(){ if(base) munmap((void*)base,mapped); }
+};